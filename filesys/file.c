@@ -2,6 +2,19 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#ifdef VM
+#include "filesys/page_cache.h"
+#endif
+
+/* File data are read and written through the page cache, where there
+ * is one, so that they are the same pages that file mappings map. */
+#ifdef VM
+#define file_data_read page_cache_read
+#define file_data_write page_cache_write
+#else
+#define file_data_read inode_read_at
+#define file_data_write inode_write_at
+#endif
 
 /* An open file. */
 struct file {
@@ -71,7 +84,7 @@ file_get_inode (struct file *file) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) {
-	off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+	off_t bytes_read = file_data_read (file->inode, buffer, size, file->pos);
 	file->pos += bytes_read;
 	return bytes_read;
 }
@@ -83,7 +96,7 @@ file_read (struct file *file, void *buffer, off_t size) {
  * The file's current position is unaffected. */
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
-	return inode_read_at (file->inode, buffer, size, file_ofs);
+	return file_data_read (file->inode, buffer, size, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -95,7 +108,7 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) {
  * Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) {
-	off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+	off_t bytes_written = file_data_write (file->inode, buffer, size, file->pos);
 	file->pos += bytes_written;
 	return bytes_written;
 }
@@ -110,15 +123,20 @@ file_write (struct file *file, const void *buffer, off_t size) {
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
 		off_t file_ofs) {
-	return inode_write_at (file->inode, buffer, size, file_ofs);
+	return file_data_write (file->inode, buffer, size, file_ofs);
 }
 
 /* Prevents write operations on FILE's underlying inode
- * until file_allow_write() is called or FILE is closed. */
+ * until file_allow_write() is called or FILE is closed.  Data already
+ * written to the page cache are written back first, since they could
+ * not be afterward. */
 void
 file_deny_write (struct file *file) {
 	ASSERT (file != NULL);
 	if (!file->deny_write) {
+#ifdef VM
+		page_cache_sync_inode (file->inode);
+#endif
 		file->deny_write = true;
 		inode_deny_write (file->inode);
 	}
@@ -1,6 +1,46 @@
-/* page_cache.c: Implementation of Page Cache (Buffer Cache). */
+/* page_cache.c: Implementation of Page Cache (Buffer Cache).
 
+   File data are cached a page at a time in user frames.  Each cached
+   page is a struct page of type VM_PAGE_CACHE that belongs to no
+   process and is found by the inode and the page-aligned offset that
+   it caches.  read() and write() copy through these pages, and file
+   mappings map them directly, so that every process that reads,
+   writes or maps a file sees the same frames and each page of a file
+   is read from the disk once, however many use it.
+
+   The frames are in the frame table like any other and are evicted
+   like any other: a page that write() made dirty is written back
+   first, and an evicted page leaves the cache.  Dirty pages also reach
+   the disk after flush_age seconds, from the worker thread, which
+   flushes the pages of file mappings in the same batches, and at
+   shutdown.
+
+   The cache is protected by the frame lock, which is taken before the
+   file system lock.  Each cached page holds its inode open, so that
+   the inode outlives every page that caches it; the worker drops the
+   pages of removed files once nothing maps them, which lets the last
+   close free their blocks.  The free map is read and written with the
+   file system lock held, so it bypasses the cache. */
+
+#include "filesys/page_cache.h"
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
 #include "vm/vm.h"
+
+#ifdef VM
+/* Most pages read with one read on a miss: the page missed and the
+ * pages after it that are not cached yet. */
+#define CACHE_CLUSTER 8
+
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
@@ -15,36 +55,615 @@ static const struct page_operations page_cache_op = {
 
 tid_t page_cache_workerd;
 
+static struct hash cache_pages;    /* Cached pages, by inode and offset. */
+static struct list cache_list;     /* The same pages, for the worker. */
+static bool cache_ready;           /* Is the cache in use yet? */
+static uint64_t write_epoch;       /* Writes of file data to the disk. */
+
+/* Statistics. */
+static long long hit_cnt;          /* Pages found in the cache. */
+static long long miss_cnt;         /* Pages read in... */
+static long long read_cnt;         /* ...and the reads that did it. */
+static long long writeback_cnt;    /* Dirty pages written back... */
+static long long write_cnt;        /* ...and the writes that did it. */
+static long long drop_cnt;         /* Pages that left the cache. */
+
+static void page_cache_kworkerd (void *aux);
+static uint64_t cache_hash (const struct hash_elem *, void *aux);
+static bool cache_less (const struct hash_elem *, const struct hash_elem *,
+		void *aux);
+
 /* The initializer of file vm */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	if (!hash_init (&cache_pages, cache_hash, cache_less, NULL))
+		PANIC ("cannot make page cache table");
+	list_init (&cache_list);
+}
+
+/* Puts the cache in use and starts its worker.  Called once the frame
+ * lock exists. */
+void
+page_cache_start (void) {
+	page_cache_workerd = thread_create ("kworkerd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	if (page_cache_workerd == TID_ERROR)
+		PANIC ("cannot start page cache worker");
+	cache_ready = true;
 }
 
 /* Initialize the page cache */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &page_cache_op;
 
+	struct page_cache *pc = &page->page_cache;
+	pc->dirty = false;
+	pc->accessed = false;
+	pc->dirty_since = 0;
+	return true;
+}
+
+/* Takes the frame lock unless the caller holds it already, and
+ * returns true if it did. */
+static bool
+cache_lock (void) {
+	if (vm_lock_held ())
+		return false;
+	ASSERT (!lock_held_by_current_thread (&filesys_lock));
+	vm_lock ();
+	return true;
+}
+
+/* Releases the frame lock if cache_lock() took it. */
+static void
+cache_unlock (bool locked) {
+	if (locked)
+		vm_unlock ();
+}
+
+/* Returns true if INODE is to bypass the cache. */
+static bool
+cache_bypass (struct inode *inode) {
+	return !cache_ready || inode_get_inumber (inode) == FREE_MAP_SECTOR;
+}
+
+/* Returns the cached page of INODE at OFS, or NULL. */
+static struct page *
+cache_lookup (struct inode *inode, off_t ofs) {
+	struct page key;
+	struct hash_elem *e;
+
+	key.page_cache.inode = inode;
+	key.page_cache.ofs = ofs;
+	e = hash_find (&cache_pages, &key.page_cache.elem);
+	return e != NULL ? hash_entry (e, struct page, page_cache.elem) : NULL;
+}
+
+/* Returns a new page for the page of INODE at OFS, not yet in the
+ * cache and without a frame, or NULL if memory is short. */
+static struct page *
+cache_new (struct inode *inode, off_t ofs) {
+	struct page *page = malloc (sizeof *page);
+
+	if (page == NULL)
+		return NULL;
+	*page = (struct page) { .va = NULL };
+	page_cache_initializer (page, VM_PAGE_CACHE, NULL);
+	page->page_cache.inode = inode;
+	page->page_cache.ofs = ofs;
+	return page;
+}
+
+/* Enters PAGE, which now has a frame, into the cache. */
+static void
+cache_insert (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+
+	inode_reopen (pc->inode);
+	hash_insert (&cache_pages, &pc->elem);
+	list_push_back (&cache_list, &pc->list_elem);
+}
+
+/* Reads the page of INODE at OFS into the cache, along with the pages
+ * after it that are not cached yet, up to CACHE_CLUSTER in all and
+ * with one read if adjacent frames are free.  If UNLOCK is true, the
+ * frame lock is released during that read, as the readahead thread
+ * does; pages cached meanwhile are kept over the ones read, and a
+ * read that a write to the disk may have overtaken is done again with
+ * the lock held.  Returns the page at OFS, or NULL if memory is short
+ * or the read fails. */
+static struct page *
+cache_fill (struct inode *inode, off_t ofs, bool unlock) {
+	off_t length = inode_length (inode), bytes;
+	struct page *first = NULL;
+	uint64_t epoch = 0;
+	size_t cnt, i;
+	uint8_t *kva;
+	bool ok;
+
+	for (cnt = 1; cnt < CACHE_CLUSTER && ofs + (off_t) (cnt * PGSIZE) < length
+			&& cache_lookup (inode, ofs + cnt * PGSIZE) == NULL; cnt++)
+		continue;
+	kva = cnt > 1 || unlock ? palloc_get_multiple (PAL_USER, cnt) : NULL;
+	if (kva == NULL) {
+		/* One page, evicting another for it if need be. */
+		first = cache_new (inode, ofs);
+		if (first == NULL)
+			return NULL;
+		if (!vm_cache_claim (first)) {
+			free (first);
+			return NULL;
+		}
+		cache_insert (first);
+		miss_cnt++;
+		read_cnt++;
+		return first;
+	}
+
+	bytes = length - ofs < (off_t) (cnt * PGSIZE)
+		? length - ofs : (off_t) (cnt * PGSIZE);
+	if (unlock) {
+		epoch = page_cache_epoch ();
+		vm_unlock ();
+	}
+	ok = page_cache_read_direct (inode, kva, bytes, ofs) == bytes;
+	if (unlock) {
+		vm_lock ();
+		if (ok && page_cache_epoch () != epoch) {
+			palloc_free_multiple (kva, cnt);
+			first = cache_lookup (inode, ofs);
+			return first != NULL ? first : cache_fill (inode, ofs, false);
+		}
+	}
+	if (!ok) {
+		palloc_free_multiple (kva, cnt);
+		return NULL;
+	}
+	memset (kva + bytes, 0, cnt * PGSIZE - bytes);
+	read_cnt++;
+	for (i = 0; i < cnt; i++) {
+		struct page *page = cache_lookup (inode, ofs + i * PGSIZE);
+
+		if (page != NULL) {
+			/* Cached while the lock was released. */
+			palloc_free_page (kva + i * PGSIZE);
+			if (i == 0)
+				first = page;
+			continue;
+		}
+		page = cache_new (inode, ofs + i * PGSIZE);
+		if (page == NULL || !vm_cache_install (page, kva + i * PGSIZE)) {
+			free (page);
+			palloc_free_multiple (kva + i * PGSIZE, cnt - i);
+			break;
+		}
+		cache_insert (page);
+		miss_cnt++;
+		if (i == 0)
+			first = page;
+	}
+	return first;
+}
+
+/* Returns the cached page of INODE at OFS, reading it in if it is not
+ * cached, or NULL if memory is short or the read fails.  UNLOCK is as
+ * for cache_fill(). */
+static struct page *
+cache_get (struct inode *inode, off_t ofs, bool unlock) {
+	struct page *page = cache_lookup (inode, ofs);
+
+	if (page == NULL)
+		return cache_fill (inode, ofs, unlock);
+	hit_cnt++;
+	return page;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFS, through
+ * the cache.  Returns the number of bytes read, which is less than
+ * SIZE at the end of the file or if memory is short.  Takes the frame
+ * lock for a page at a time, unless the caller holds it, and releases
+ * it while reading from the disk; the caller must not hold the file
+ * system lock without it.  BUFFER must not fault with the frame lock
+ * held, so a user buffer must be pinned. */
+off_t
+page_cache_read (struct inode *inode, void *buffer_, off_t size, off_t ofs) {
+	uint8_t *buffer = buffer_;
+	off_t length, bytes_read = 0;
+	bool locked;
+
+	if (cache_bypass (inode))
+		return page_cache_read_direct (inode, buffer, size, ofs);
+
+	length = inode_length (inode);
+	while (size > 0 && ofs < length) {
+		off_t page_ofs = ofs & PGMASK;
+		off_t chunk = PGSIZE - page_ofs;
+		struct page *page;
+
+		if (chunk > size)
+			chunk = size;
+		if (chunk > length - ofs)
+			chunk = length - ofs;
+		locked = cache_lock ();
+		page = cache_get (inode, ofs - page_ofs, locked);
+		if (page != NULL) {
+			memcpy (buffer + bytes_read,
+					(uint8_t *) page->frame->kva + page_ofs, chunk);
+			page->page_cache.accessed = true;
+		}
+		cache_unlock (locked);
+		if (page == NULL)
+			break;
+
+		size -= chunk;
+		ofs += chunk;
+		bytes_read += chunk;
+	}
+	return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFS, through
+ * the cache, locking as page_cache_read() does.  Files do not grow,
+ * so the write stops at the end of the file.  Returns the number of
+ * bytes written, which is 0 if writes to INODE are denied. */
+off_t
+page_cache_write (struct inode *inode, const void *buffer_, off_t size,
+		off_t ofs) {
+	const uint8_t *buffer = buffer_;
+	off_t length, bytes_written = 0;
+	bool locked;
+
+	if (cache_bypass (inode))
+		return page_cache_write_direct (inode, buffer, size, ofs);
+
+	length = inode_length (inode);
+	while (size > 0 && ofs < length) {
+		off_t page_ofs = ofs & PGMASK;
+		off_t chunk = PGSIZE - page_ofs;
+		struct page *page = NULL;
+
+		if (chunk > size)
+			chunk = size;
+		if (chunk > length - ofs)
+			chunk = length - ofs;
+		locked = cache_lock ();
+		if (!inode_write_denied (inode))
+			page = cache_get (inode, ofs - page_ofs, locked);
+		if (page != NULL) {
+			struct page_cache *pc = &page->page_cache;
+
+			memcpy ((uint8_t *) page->frame->kva + page_ofs,
+					buffer + bytes_written, chunk);
+			if (!pc->dirty)
+				pc->dirty_since = timer_ticks ();
+			pc->dirty = true;
+			pc->accessed = true;
+		}
+		cache_unlock (locked);
+		if (page == NULL)
+			break;
+
+		size -= chunk;
+		ofs += chunk;
+		bytes_written += chunk;
+	}
+	return bytes_written;
+}
+
+/* Returns the frame that holds the page of INODE at OFS if it is
+ * cached, or NULL.  The frame lock must be held. */
+struct frame *
+page_cache_lookup (struct inode *inode, off_t ofs) {
+	struct page *page;
+
+	ASSERT (vm_lock_held ());
+
+	page = cache_ready ? cache_lookup (inode, ofs) : NULL;
+	if (page == NULL)
+		return NULL;
+	hit_cnt++;
+	return page->frame;
+}
+
+/* Returns the frame that holds the page of INODE at OFS, reading it
+ * in if it is not cached, or NULL if memory is short or the read
+ * fails.  The frame lock must be held. */
+struct frame *
+page_cache_get (struct inode *inode, off_t ofs) {
+	struct page *page;
+
+	ASSERT (vm_lock_held ());
+	ASSERT ((ofs & PGMASK) == 0);
+
+	page = cache_get (inode, ofs, false);
+	return page != NULL ? page->frame : NULL;
+}
+
+/* Gives the page of INODE at OFS the user page at KVA, which holds its
+ * contents as on the disk, unless it is cached already, in which case
+ * KVA is freed.  The frame lock must be held.  Returns the frame of
+ * the cached page, or NULL, with KVA freed, if memory is short. */
+struct frame *
+page_cache_install (struct inode *inode, off_t ofs, void *kva) {
+	struct page *page;
+
+	ASSERT (vm_lock_held ());
+	ASSERT ((ofs & PGMASK) == 0);
+
+	page = cache_lookup (inode, ofs);
+	if (page != NULL) {
+		palloc_free_page (kva);
+		hit_cnt++;
+		return page->frame;
+	}
+	page = cache_new (inode, ofs);
+	if (page == NULL || !vm_cache_install (page, kva)) {
+		free (page);
+		palloc_free_page (kva);
+		return NULL;
+	}
+	cache_insert (page);
+	miss_cnt++;
+	return page->frame;
 }
 
-/* Utilze the Swap in mechanism to implement readhead */
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFS, from the
+ * disk, bypassing the cache.  Takes the file system lock unless the
+ * caller holds it. */
+off_t
+page_cache_read_direct (struct inode *inode, void *buffer, off_t size,
+		off_t ofs) {
+	bool held = lock_held_by_current_thread (&filesys_lock);
+	off_t bytes;
+
+	if (!held)
+		lock_acquire (&filesys_lock);
+	bytes = inode_read_at (inode, buffer, size, ofs);
+	if (!held)
+		lock_release (&filesys_lock);
+	return bytes;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFS, to the
+ * disk, bypassing the cache.  For data that are in the cache already,
+ * such as the pages of a file mapping.  Locks as
+ * page_cache_read_direct() does. */
+off_t
+page_cache_write_direct (struct inode *inode, const void *buffer,
+		off_t size, off_t ofs) {
+	bool held = lock_held_by_current_thread (&filesys_lock);
+	off_t bytes;
+
+	if (!held)
+		lock_acquire (&filesys_lock);
+	bytes = inode_write_at (inode, buffer, size, ofs);
+	write_epoch++;
+	if (!held)
+		lock_release (&filesys_lock);
+	return bytes;
+}
+
+/* Returns a count of the writes of file data to the disk.  A read
+ * from the disk made without the frame lock is still good to cache if
+ * the count is the same before and after. */
+uint64_t
+page_cache_epoch (void) {
+	return write_epoch;
+}
+
+/* Utilze the Swap in mechanism to implement readhead.  Reads PAGE in
+ * from the disk, with zeros past the end of the file; cache_fill()
+ * reads the pages after it along with it when it can. */
 static bool
 page_cache_readahead (struct page *page, void *kva) {
+	struct page_cache *pc = &page->page_cache;
+	off_t bytes = inode_length (pc->inode) - pc->ofs;
+
+	if (bytes < 0)
+		bytes = 0;
+	if (bytes > PGSIZE)
+		bytes = PGSIZE;
+	if (bytes > 0
+			&& page_cache_read_direct (pc->inode, kva, bytes, pc->ofs) != bytes)
+		return false;
+	memset ((uint8_t *) kva + bytes, 0, PGSIZE - bytes);
+	pc->dirty = false;
+	pc->accessed = true;
+	return true;
+}
+
+/* Returns the cached page of INODE at OFS if it is resident and
+ * write() made it dirty, or NULL. */
+static struct page *
+cache_dirty (struct inode *inode, off_t ofs) {
+	struct page *page = cache_lookup (inode, ofs);
+
+	return page != NULL && page->frame != NULL && page->page_cache.dirty
+		? page : NULL;
 }
 
-/* Utilze the Swap out mechanism to implement writeback */
+/* Utilze the Swap out mechanism to implement writeback.  Writes PAGE,
+ * which is resident, back to the disk if write() made it dirty, along
+ * with the dirty pages next to it among the CACHE_CLUSTER pages that
+ * a miss would read together, with one write if memory allows.  They
+ * would likely be evicted soon after it, a write each. */
 static bool
 page_cache_writeback (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	off_t base = pc->ofs - pc->ofs % (CACHE_CLUSTER * PGSIZE);
+	off_t first = pc->ofs, end = pc->ofs + PGSIZE, bytes, ofs;
+	size_t cnt;
+	uint8_t *buf;
+	bool ok;
+
+	if (!pc->dirty)
+		return true;
+	while (first > base && cache_dirty (pc->inode, first - PGSIZE) != NULL)
+		first -= PGSIZE;
+	while (end < base + CACHE_CLUSTER * PGSIZE
+			&& cache_dirty (pc->inode, end) != NULL)
+		end += PGSIZE;
+	cnt = (end - first) / PGSIZE;
+	buf = cnt > 1 ? palloc_get_multiple (0, cnt) : NULL;
+	if (buf == NULL) {
+		/* No room to gather pages: write this one on its own. */
+		first = pc->ofs;
+		end = pc->ofs + PGSIZE;
+	} else
+		for (ofs = first; ofs < end; ofs += PGSIZE)
+			memcpy (buf + (ofs - first),
+					cache_lookup (pc->inode, ofs)->frame->kva, PGSIZE);
+
+	bytes = inode_length (pc->inode) - first;
+	if (bytes > end - first)
+		bytes = end - first;
+	ok = bytes <= 0 || page_cache_write_direct (pc->inode,
+			buf != NULL ? buf : page->frame->kva, bytes, first) == bytes;
+	if (buf != NULL)
+		palloc_free_multiple (buf, cnt);
+	if (!ok)
+		return false;
+
+	for (ofs = first; ofs < end; ofs += PGSIZE) {
+		struct page_cache *run = &cache_lookup (pc->inode, ofs)->page_cache;
+
+		run->dirty = false;
+		run->dirty_since = 0;
+		writeback_cnt++;
+	}
+	write_cnt++;
+	return true;
 }
 
-/* Destory the page_cache. */
+/* Destory the page_cache.  PAGE leaves the cache and lets go of its
+ * inode; it will be freed by the caller. */
 static void
 page_cache_destroy (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	bool held = lock_held_by_current_thread (&filesys_lock);
+
+	hash_delete (&cache_pages, &pc->elem);
+	list_remove (&pc->list_elem);
+	if (!held)
+		lock_acquire (&filesys_lock);
+	inode_close (pc->inode);
+	if (!held)
+		lock_release (&filesys_lock);
+	drop_cnt++;
+}
+
+/* Writes back the dirty pages of INODE, or of every file if INODE is
+ * null. */
+static void
+cache_sync (struct inode *inode) {
+	struct list_elem *e;
+	bool locked;
+
+	if (!cache_ready)
+		return;
+	locked = cache_lock ();
+	for (e = list_begin (&cache_list); e != list_end (&cache_list);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, page_cache.list_elem);
+
+		if (inode == NULL || page->page_cache.inode == inode)
+			page_cache_writeback (page);
+	}
+	cache_unlock (locked);
+}
+
+/* Writes back the dirty pages of INODE, before writes to it are
+ * denied, which would keep them from being written back later. */
+void
+page_cache_sync_inode (struct inode *inode) {
+	cache_sync (inode);
 }
 
-/* Worker thread for page cache */
+/* Writes back every dirty page, at shutdown. */
+void
+page_cache_sync (void) {
+	cache_sync (NULL);
+}
+
+/* Copies into FB the pages that write() made dirty flush_age seconds
+ * or more before NOW, and marks them clean, for vm_file_flush(), which
+ * holds the frame lock and the file system lock.  Stops when FB is
+ * full. */
+void
+page_cache_flush (struct flush_batch *fb, int64_t now) {
+	struct list_elem *e;
+
+	for (e = list_begin (&cache_list); e != list_end (&cache_list);
+			e = list_next (e)) {
+		struct page *page = list_entry (e, struct page, page_cache.list_elem);
+		struct page_cache *pc = &page->page_cache;
+		off_t bytes;
+
+		if (!pc->dirty || page->frame == NULL
+				|| now - pc->dirty_since < flush_age * TIMER_FREQ)
+			continue;
+		bytes = inode_length (pc->inode) - pc->ofs;
+		if (bytes > PGSIZE)
+			bytes = PGSIZE;
+		if (bytes > 0 && !flush_batch_add (fb, pc->inode, pc->ofs,
+					page->frame->kva, bytes))
+			return;
+		pc->dirty = false;
+		pc->dirty_since = 0;
+	}
+}
+
+/* Worker thread for page cache.  Once a second, drops the pages of
+ * removed files that nothing maps, then has vm_file_flush() write back
+ * the pages of the cache and of file mappings that have been dirty for
+ * flush_age seconds. */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;) {
+		struct list_elem *e;
+
+		timer_sleep (TIMER_FREQ);
+		vm_lock ();
+		for (e = list_begin (&cache_list); e != list_end (&cache_list); ) {
+			struct page *page = list_entry (e, struct page,
+					page_cache.list_elem);
+
+			e = list_next (e);
+			if (inode_is_removed (page->page_cache.inode))
+				vm_cache_drop (page);
+		}
+		vm_unlock ();
+		vm_file_flush ();
+	}
+}
+
+static uint64_t
+cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page_cache *pc = hash_entry (e, struct page_cache, elem);
+
+	return hash_bytes (&pc->inode, sizeof pc->inode) ^ hash_int (pc->ofs);
+}
+
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct page_cache *a = hash_entry (a_, struct page_cache, elem);
+	const struct page_cache *b = hash_entry (b_, struct page_cache, elem);
+
+	if (a->inode != b->inode)
+		return a->inode < b->inode;
+	return a->ofs < b->ofs;
+}
+
+/* Prints page cache statistics. */
+void
+page_cache_print_stats (void) {
+	printf ("Page cache: %zu pages, %lld hits, %lld pages read in %lld "
+			"reads, %lld written back in %lld writes, %lld dropped\n",
+			hash_size (&cache_pages), hit_cnt, miss_cnt, read_cnt,
+			writeback_cnt, write_cnt, drop_cnt);
 }
+#endif /* VM */
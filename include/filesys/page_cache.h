@@ -1,12 +1,51 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
 
 struct page;
+struct frame;
+struct inode;
+struct flush_batch;
 enum vm_type;
 
-struct page_cache {};
+/* A page of file data in the page cache. */
+struct page_cache {
+	struct inode *inode;   /* File it caches, held open. */
+	off_t ofs;             /* Page-aligned offset in INODE. */
+	struct hash_elem elem; /* In the cache's table. */
+	struct list_elem list_elem;  /* In the cache's list. */
+	bool dirty;            /* Written by write() since it was saved? */
+	bool accessed;         /* Read or written since last cleared? */
+	int64_t dirty_since;   /* When write() made it dirty, or 0. */
+};
 
-void page_cache_init (void);
+void pagecache_init (void);
+void page_cache_start (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+off_t page_cache_read (struct inode *inode, void *buffer, off_t size,
+		off_t ofs);
+off_t page_cache_write (struct inode *inode, const void *buffer, off_t size,
+		off_t ofs);
+struct frame *page_cache_lookup (struct inode *inode, off_t ofs);
+struct frame *page_cache_get (struct inode *inode, off_t ofs);
+struct frame *page_cache_install (struct inode *inode, off_t ofs, void *kva);
+off_t page_cache_read_direct (struct inode *inode, void *buffer, off_t size,
+		off_t ofs);
+off_t page_cache_write_direct (struct inode *inode, const void *buffer,
+		off_t size, off_t ofs);
+uint64_t page_cache_epoch (void);
+void page_cache_sync_inode (struct inode *inode);
+void page_cache_sync (void);
+void page_cache_flush (struct flush_batch *fb, int64_t now);
+void page_cache_print_stats (void);
+
+/* For page_cache.c, in vm.c. */
+bool vm_cache_claim (struct page *page);
+bool vm_cache_install (struct page *page, void *kva);
+bool vm_cache_drop (struct page *page);
+bool vm_lock_held (void);
 #endif
@@ -0,0 +1,29 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ compression.
+ *
+ * A byte-oriented LZ77 compressor in the style of LZ4: the input is
+ * coded as a series of literal runs, each followed by a copy of
+ * earlier output.  Matches are found through a hash table of recent
+ * positions, with no search, so compression is fast and
+ * decompression faster, at some cost in ratio.  It is meant for
+ * data such as memory pages, where speed matters more than size.
+ *
+ * Inputs are at most LZ_MAX_INPUT bytes.  The caller supplies the
+ * compressor's hash table, LZ_WORK_SIZE bytes, so that compression
+ * needs no memory of its own and little stack. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define LZ_HASH_BITS 12                             /* Hash table index bits. */
+#define LZ_WORK_SIZE ((1 << LZ_HASH_BITS) * 2)      /* Bytes of work area. */
+#define LZ_MAX_INPUT 65536                          /* Largest input. */
+
+size_t lz_compress (const void *src, size_t src_len, void *dst,
+		size_t dst_cap, void *work);
+bool lz_decompress (const void *src, size_t src_len, void *dst,
+		size_t dst_len);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,107 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressing hash table.
+ *
+ * A drop-in alternative to the chained table in hash.h for hot
+ * lookups.  Elements are not linked together; instead the table
+ * is an array of pointers to them, split into groups of eight
+ * slots.  Each slot has a one-byte control tag holding seven bits
+ * of the element's hash, so a lookup examines the tags of a whole
+ * group with a few word operations and only follows a pointer when
+ * the tag matches.  This is the layout of Google's "Swiss tables",
+ * using plain 64-bit arithmetic instead of SSE.
+ *
+ * Growing the table never moves all elements at once.  A larger
+ * table is allocated and each later operation moves a few groups
+ * of the old one into it, so no single insertion pays for the
+ * whole table.  Until the old table is empty, lookups search
+ * both.
+ *
+ * As with hash.h, each structure that can be in the table embeds
+ * a struct ohash_elem, and ohash_entry converts back from it.  The
+ * element caches its hash value, so the hash function runs once
+ * per insertion or lookup and never while resizing. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hash element. */
+struct ohash_elem {
+	uint64_t hash;              /* Cached hash value. */
+};
+
+/* Converts pointer to hash element OHASH_ELEM into a pointer to
+ * the structure that OHASH_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the hash element. */
+#define ohash_entry(OHASH_ELEM, STRUCT, MEMBER)                 \
+	((STRUCT *) ((uint8_t *) (OHASH_ELEM)                   \
+		- offsetof (STRUCT, MEMBER)))
+
+/* Computes and returns the hash value for hash element E, given
+ * auxiliary data AUX. */
+typedef uint64_t ohash_hash_func (const struct ohash_elem *e, void *aux);
+
+/* Compares the value of two hash elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool ohash_less_func (const struct ohash_elem *a,
+		const struct ohash_elem *b,
+		void *aux);
+
+/* Performs some operation on hash element E, given auxiliary
+ * data AUX. */
+typedef void ohash_action_func (struct ohash_elem *e, void *aux);
+
+/* One array of slots. */
+struct ohash_table {
+	size_t group_cnt;           /* Number of groups, a power of 2. */
+	size_t used;                /* Slots that are full or deleted. */
+	uint8_t *ctrl;              /* Control tag of each slot. */
+	struct ohash_elem **slots;  /* Element in each slot. */
+};
+
+/* Hash table. */
+struct ohash {
+	size_t elem_cnt;            /* Number of elements in table. */
+	struct ohash_table cur;     /* Table that takes insertions. */
+	struct ohash_table old;     /* Table being emptied, if any. */
+	size_t migrated;            /* Groups of `old' already moved. */
+	ohash_hash_func *hash;      /* Hash function. */
+	ohash_less_func *less;      /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `hash' and `less'. */
+};
+
+/* A hash table iterator. */
+struct ohash_iterator {
+	struct ohash *hash;         /* The hash table. */
+	struct ohash_table *table;  /* Current table. */
+	size_t slot;                /* Current slot in current table. */
+	struct ohash_elem *elem;    /* Current hash element. */
+};
+
+/* Basic life cycle. */
+bool ohash_init (struct ohash *, ohash_hash_func *, ohash_less_func *,
+		void *aux);
+void ohash_clear (struct ohash *, ohash_action_func *);
+void ohash_destroy (struct ohash *, ohash_action_func *);
+
+/* Search, insertion, deletion. */
+struct ohash_elem *ohash_insert (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_replace (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_find (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_delete (struct ohash *, struct ohash_elem *);
+
+/* Iteration. */
+void ohash_apply (struct ohash *, ohash_action_func *);
+void ohash_first (struct ohash_iterator *, struct ohash *);
+struct ohash_elem *ohash_next (struct ohash_iterator *);
+struct ohash_elem *ohash_cur (struct ohash_iterator *);
+
+/* Information. */
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
+#endif /* lib/kernel/ohash.h */
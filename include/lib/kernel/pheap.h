@@ -0,0 +1,64 @@
+#ifndef __LIB_KERNEL_PHEAP_H
+#define __LIB_KERNEL_PHEAP_H
+
+/* Pairing heap.
+ *
+ * A priority queue that keeps its least element at the top.
+ * Insertion and merging take O(1) time, and removing the top or
+ * any other element takes amortized O(log n) time.  It suits
+ * queues that are mostly pushed to and popped from the front,
+ * like a ready queue ordered by priority or a sleep queue ordered
+ * by wakeup time, better than a sorted list, whose insertion is
+ * O(n).
+ *
+ * The heap does not allocate memory.  Each structure that can be
+ * in a heap embeds a struct pheap_elem member, and pheap_entry
+ * converts back from it, as with list_entry. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct pheap_elem {
+	struct pheap_elem *child;   /* First child. */
+	struct pheap_elem *next;    /* Next sibling. */
+	struct pheap_elem *prev;    /* Previous sibling, or the parent
+	                               for a first child. */
+};
+
+/* Converts pointer to heap element PHEAP_ELEM into a pointer to
+ * the structure that PHEAP_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the heap element. */
+#define pheap_entry(PHEAP_ELEM, STRUCT, MEMBER)                 \
+	((STRUCT *) ((uint8_t *) &(PHEAP_ELEM)->child           \
+		- offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or false
+ * if A is greater than or equal to B. */
+typedef bool pheap_less_func (const struct pheap_elem *a,
+		const struct pheap_elem *b,
+		void *aux);
+
+/* Pairing heap. */
+struct pheap {
+	struct pheap_elem *root;    /* Least element, or null. */
+	size_t elem_cnt;            /* Number of elements. */
+	pheap_less_func *less;      /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void pheap_init (struct pheap *, pheap_less_func *, void *aux);
+
+void pheap_push (struct pheap *, struct pheap_elem *);
+struct pheap_elem *pheap_top (const struct pheap *);
+struct pheap_elem *pheap_pop (struct pheap *);
+void pheap_remove (struct pheap *, struct pheap_elem *);
+void pheap_decrease (struct pheap *, struct pheap_elem *);
+
+size_t pheap_size (const struct pheap *);
+bool pheap_empty (const struct pheap *);
+
+#endif /* lib/kernel/pheap.h */
@@ -0,0 +1,84 @@
+#ifndef __LIB_KERNEL_RADIX_H
+#define __LIB_KERNEL_RADIX_H
+
+/* Radix tree.
+ *
+ * Maps 64-bit keys to non-null pointers.  Each node covers 6 bits
+ * of the key with 64 slots, and nodes are only allocated along
+ * the paths to keys that are present, so a sparse set of keys,
+ * such as the user pages of a process or the cached blocks of a
+ * file, costs memory in proportion to the number of clusters of
+ * keys, not to the key range.  The tree is only as tall as the
+ * largest key needs.
+ *
+ * Each entry carries RADIX_TAG_CNT tag bits, which are summarized
+ * in every node above it, so that the entries with a given tag,
+ * say all the dirty pages of a file, can be found without
+ * visiting the others.
+ *
+ * Unlike lists and hash tables, the tree allocates its nodes with
+ * malloc(), so insertion may fail. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RADIX_BITS 6                        /* Key bits per level. */
+#define RADIX_SLOTS (1 << RADIX_BITS)       /* Slots per node. */
+
+/* Tags.  Their meaning is up to the user; the names are the usual
+ * ones for page tables and caches. */
+enum radix_tag {
+	RADIX_TAG_DIRTY,            /* Modified. */
+	RADIX_TAG_ACCESSED,         /* Referenced recently. */
+	RADIX_TAG_WRITEBACK,        /* Being written out. */
+	RADIX_TAG_CNT,              /* Number of tags. */
+	RADIX_ANY = -1              /* Any entry, for the search functions. */
+};
+
+/* Tree node. */
+struct radix_node {
+	struct radix_node *parent;  /* Parent, or null for the root. */
+	unsigned shift;             /* Key bits below this level. */
+	unsigned offset;            /* Slot in parent. */
+	uint64_t present;           /* Bit set for each non-null slot. */
+	uint64_t tags[RADIX_TAG_CNT];   /* Bit set for each tagged slot. */
+	void *slots[RADIX_SLOTS];   /* Children, or entries at the bottom. */
+};
+
+/* Radix tree. */
+struct radix_tree {
+	struct radix_node *root;    /* Root node, or null if empty. */
+	size_t entry_cnt;           /* Number of entries. */
+	size_t node_cnt;            /* Number of nodes. */
+};
+
+/* Called on each entry ITEM, with key KEY, given auxiliary data
+ * AUX. */
+typedef void radix_action_func (uint64_t key, void *item, void *aux);
+
+void radix_init (struct radix_tree *);
+void radix_destroy (struct radix_tree *, radix_action_func *, void *aux);
+
+/* Single entries. */
+bool radix_insert (struct radix_tree *, uint64_t key, void *item);
+void *radix_lookup (const struct radix_tree *, uint64_t key);
+void *radix_delete (struct radix_tree *, uint64_t key);
+
+/* Tags. */
+bool radix_tag_set (struct radix_tree *, uint64_t key, enum radix_tag);
+void radix_tag_clear (struct radix_tree *, uint64_t key, enum radix_tag);
+bool radix_tag_get (const struct radix_tree *, uint64_t key,
+		enum radix_tag);
+
+/* Ordered search. */
+void *radix_next (const struct radix_tree *, uint64_t *key, uint64_t last,
+		enum radix_tag);
+size_t radix_gang_lookup (const struct radix_tree *, uint64_t first,
+		size_t max, void **items, uint64_t *keys, enum radix_tag);
+
+/* Information. */
+size_t radix_size (const struct radix_tree *);
+size_t radix_footprint (const struct radix_tree *);
+
+#endif /* lib/kernel/radix.h */
@@ -0,0 +1,104 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * A balanced binary search tree: insertion, removal, and search
+ * take O(log n) time, and the elements can be walked in order in
+ * either direction.  Elements that compare equal are kept in
+ * insertion order, like list_insert_ordered() does.
+ *
+ * As with lists, the tree does not allocate memory.  Each
+ * structure that can be in a tree embeds a struct rb_node member,
+ * and rb_entry converts a pointer to that member back into a
+ * pointer to the enclosing structure:
+ *
+ *      struct foo {
+ *        struct rb_node node;
+ *        int bar;
+ *        ...other members...
+ *      };
+ *
+ *      static bool
+ *      foo_less (const struct rb_node *a, const struct rb_node *b,
+ *                void *aux UNUSED) {
+ *        return rb_entry (a, struct foo, node)->bar
+ *               < rb_entry (b, struct foo, node)->bar;
+ *      }
+ *
+ *      struct rbtree foo_tree;
+ *      rb_init (&foo_tree, foo_less, NULL);
+ *      ...
+ *      for (n = rb_first (&foo_tree); n != NULL; n = rb_next (n)) {
+ *        struct foo *f = rb_entry (n, struct foo, node);
+ *        ...do something with f...
+ *      }
+ *
+ * Searches take a key node, usually a node embedded in a
+ * structure on the stack with just the compared members filled
+ * in.  The range [lo, hi) is walked as
+ *
+ *      for (n = rb_lower_bound (t, lo); n != NULL
+ *             && t->less (n, hi, t->aux); n = rb_next (n))
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree node. */
+struct rb_node {
+	struct rb_node *parent;     /* Parent, or null for the root. */
+	struct rb_node *left;       /* Lesser children. */
+	struct rb_node *right;      /* Greater or equal children. */
+	bool red;                   /* Red or black. */
+};
+
+/* Converts pointer to tree node RB_NODE into a pointer to the
+ * structure that RB_NODE is embedded inside.  Supply the name of
+ * the outer structure STRUCT and the member name MEMBER of the
+ * tree node. */
+#define rb_entry(RB_NODE, STRUCT, MEMBER)                       \
+	((STRUCT *) ((uint8_t *) &(RB_NODE)->parent             \
+		- offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree nodes A and B, given auxiliary
+ * data AUX.  Returns true if A is less than B, or false if A is
+ * greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_node *a,
+		const struct rb_node *b,
+		void *aux);
+
+/* Red-black tree. */
+struct rbtree {
+	struct rb_node *root;       /* Root node, or null if empty. */
+	size_t node_cnt;            /* Number of nodes. */
+	rb_less_func *less;         /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void rb_init (struct rbtree *, rb_less_func *, void *aux);
+
+/* Insertion and removal. */
+void rb_insert (struct rbtree *, struct rb_node *);
+void rb_remove (struct rbtree *, struct rb_node *);
+
+/* Traversal. */
+struct rb_node *rb_first (const struct rbtree *);
+struct rb_node *rb_last (const struct rbtree *);
+struct rb_node *rb_next (const struct rb_node *);
+struct rb_node *rb_prev (const struct rb_node *);
+
+/* Search. */
+struct rb_node *rb_find (const struct rbtree *, const struct rb_node *key);
+struct rb_node *rb_lower_bound (const struct rbtree *,
+		const struct rb_node *key);
+struct rb_node *rb_upper_bound (const struct rbtree *,
+		const struct rb_node *key);
+struct rb_node *rb_floor (const struct rbtree *, const struct rb_node *key);
+
+/* Tree properties. */
+size_t rb_size (const struct rbtree *);
+bool rb_empty (const struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
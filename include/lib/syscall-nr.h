@@ -36,6 +36,19 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	/* Extra for Project 3 */
+	SYS_MSYNC,                  /* Write back a memory mapping. */
+	SYS_MADVISE,                /* Give advice about use of memory. */
+	SYS_MLOCK,                  /* Lock memory in. */
+	SYS_MUNLOCK,                /* Unlock memory. */
 };
 
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_RANDOM 1           /* Expect random access: no readahead. */
+#define MADV_SEQUENTIAL 2       /* Expect sequential access. */
+#define MADV_WILLNEED 3         /* Will be needed soon: read it in. */
+#define MADV_DONTNEED 4         /* Not needed: discard the contents. */
+
 #endif /* lib/syscall-nr.h */
@@ -2,23 +2,47 @@
 #define THREAD_MMU_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "threads/pte.h"
 
 typedef bool pte_for_each_func (uint64_t *pte, void *va, void *aux);
 
+/* Pending TLB invalidations for one page table, collected while
+ * many of its entries are changed and carried out together by
+ * tlb_batch_finish().  Above TLB_BATCH_LEN entries, the whole TLB
+ * of the page table is flushed instead of issuing one invlpg per
+ * page. */
+#define TLB_BATCH_LEN 32
+struct tlb_batch {
+	uint64_t *pml4;                 /* Page table being changed. */
+	size_t cnt;                     /* Number of changed entries. */
+	const void *va[TLB_BATCH_LEN];  /* First TLB_BATCH_LEN of them. */
+};
+
 uint64_t *pml4e_walk (uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create (void);
 bool pml4_for_each (uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy (uint64_t *pml4);
 void pml4_activate (uint64_t *pml4);
+void pml4_init_pcid (void);
+void pml4_print_stats (void);
+void tlb_batch_init (struct tlb_batch *, uint64_t *pml4);
+void tlb_batch_add (struct tlb_batch *, const void *va);
+void tlb_batch_finish (struct tlb_batch *);
 void *pml4_get_page (uint64_t *pml4, const void *upage);
 bool pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
 void pml4_clear_page (uint64_t *pml4, void *upage);
+void pml4_clear_range (uint64_t *pml4, void *upage, size_t page_cnt);
+bool pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_is_huge (uint64_t *pml4, const void *upage);
+bool pml4_split_huge_page (uint64_t *pml4, const void *upage);
+void pml4_clear_huge_page (uint64_t *pml4, void *upage);
 bool pml4_is_dirty (uint64_t *pml4, const void *upage);
 void pml4_set_dirty (uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed (uint64_t *pml4, const void *upage);
 void pml4_set_accessed (uint64_t *pml4, const void *upage, bool accessed);
+void pml4_set_writable (uint64_t *pml4, const void *upage, bool writable);
 
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
@@ -20,6 +20,11 @@
 #define PGSIZE  (1 << PGBITS)              /* Bytes in a page. */
 #define PGMASK  BITMASK(PGSHIFT, PGBITS)   /* Page offset bits (0:12). */
 
+/* Huge page offset (bits 0:21). */
+#define HPGBITS 21                         /* Number of huge page offset bits. */
+#define HPGSIZE (1 << HPGBITS)             /* Bytes in a huge page. */
+#define HPGMASK BITMASK(PGSHIFT, HPGBITS)  /* Huge page offset bits (0:21). */
+
 /* Offset within a page. */
 #define pg_ofs(va) ((uint64_t) (va) & PGMASK)
 
@@ -31,6 +36,15 @@
 /* Round down to nearest page boundary. */
 #define pg_round_down(va) (void *) ((uint64_t) (va) & ~PGMASK)
 
+/* Offset within a huge page. */
+#define hpg_ofs(va) ((uint64_t) (va) & HPGMASK)
+
+/* Round up to nearest huge page boundary. */
+#define hpg_round_up(va) ((void *) (((uint64_t) (va) + HPGSIZE - 1) & ~HPGMASK))
+
+/* Round down to nearest huge page boundary. */
+#define hpg_round_down(va) (void *) ((uint64_t) (va) & ~HPGMASK)
+
 /* Kernel virtual address start */
 #define KERN_BASE LOADER_KERN_BASE
 
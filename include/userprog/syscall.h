@@ -1,6 +1,11 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "threads/synch.h"
+
+/* Serializes access to the file system. */
+extern struct lock filesys_lock;
+
 void syscall_init(void);
 void close(int fd);
 
@@ -1,13 +1,25 @@
 #ifndef VM_ANON_H
 #define VM_ANON_H
+#include <stddef.h>
+#include <stdint.h>
 #include "vm/vm.h"
 struct page;
+struct zbud;
 enum vm_type;
 
+/* Swap slot of a page that is not in swap. */
+#define SWAP_NONE SIZE_MAX
+
 struct anon_page {
+	size_t slot;           /* Swap slot holding the page, or SWAP_NONE. */
+	struct zbud *zbud;     /* Compressed cache page holding it, or NULL. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_swap_cluster_begin (size_t page_cnt);
+void anon_swap_cluster_end (void);
+bool anon_swap_write (struct page *page, const void *kva);
+void anon_print_stats (void);
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef VM_EVICT_H
+#define VM_EVICT_H
+#include <stdbool.h>
+
+struct frame;
+
+/* A page replacement policy.  The frame table tells the policy which
+ * frames hold pages and asks it which one to evict; how it orders
+ * them is up to the policy.  All of these are called with the frame
+ * lock held. */
+struct evict_policy {
+	const char *name;                   /* Name on the command line. */
+	void (*init) (void);                /* Called once, from vm_init(). */
+	void (*add) (struct frame *);       /* FRAME now holds a page. */
+	void (*remove) (struct frame *);    /* FRAME's page is going away. */
+
+	/* Returns a frame to evict, not pinned, or NULL if there is none,
+	 * adding the number of frames it looked at to *SCANNED.  The frame
+	 * stays with the policy until remove() is called on it, which
+	 * does not happen if its page cannot be written out. */
+	struct frame *(*victim) (long long *scanned);
+};
+
+/* The policy in use, set by the -evict kernel option. */
+extern const struct evict_policy *evict_policy;
+
+const struct evict_policy *evict_policy_find (const char *name);
+
+/* For the policies, in vm.c. */
+bool frame_is_pinned (const struct frame *);
+bool frame_is_accessed (const struct frame *);
+void frame_clear_accessed (struct frame *);
+bool frame_is_dirty (const struct frame *);
+
+#endif  /* VM_EVICT_H */
@@ -7,11 +7,50 @@ struct page;
 enum vm_type;
 
 struct file_page {
+	int64_t dirty_since;   /* When the flusher found it dirty, or 0. */
+};
+
+struct vm_area;
+struct inode;
+
+/* Seconds a page of a file mapping or of the page cache may stay dirty
+ * before the flusher writes it back, set by the -flush kernel option.
+ * 0 turns the flusher off. */
+extern int flush_age;
+
+/* Most runs of pages that the flusher copies before writing them. */
+#define FLUSH_RUNS 8
+
+/* Dirty pages that follow each other in a file, copied for the
+ * flusher. */
+struct flush_run {
+	struct inode *inode;    /* File they belong to. */
+	off_t ofs;              /* Offset in the file of the first. */
+	off_t bytes;            /* Bytes to write. */
+	uint8_t *buf;           /* The copies. */
+	size_t cnt;             /* Pages in BUF. */
+	size_t max;             /* Pages BUF has room for. */
+};
+
+/* Runs of dirty pages copied with the frame lock held, to be written
+ * once it is released. */
+struct flush_batch {
+	struct flush_run runs[FLUSH_RUNS];
+	size_t cnt;             /* Runs in use. */
+	bool full;              /* Were pages left for another batch? */
 };
 
 void vm_file_init (void);
+void vm_file_flush (void);
+bool flush_batch_add (struct flush_batch *fb, struct inode *inode, off_t ofs,
+		const void *kva, off_t bytes);
+void file_area_add (struct vm_area *area);
+void file_area_remove (struct vm_area *area);
+bool file_area_writeback (struct vm_area *area, void *start, void *end);
+void file_print_stats (void);
 bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+bool do_msync (void *addr, size_t length);
 #endif
@@ -0,0 +1,20 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+#include <stdbool.h>
+
+struct frame;
+
+/* Anonymous frames to scan per second, set by the -ksm kernel
+ * option.  0 turns same-page merging off. */
+extern int ksm_rate;
+
+void ksm_init (void);
+void ksm_add (struct frame *);
+void ksm_remove (struct frame *);
+void ksm_write_fault (struct frame *);
+void ksm_print_stats (void);
+
+/* For ksm.c, in vm.c. */
+bool frame_merge (struct frame *dst, struct frame *src);
+
+#endif  /* VM_KSM_H */
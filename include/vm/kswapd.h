@@ -0,0 +1,19 @@
+#ifndef VM_KSWAPD_H
+#define VM_KSWAPD_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Free user pages below which kswapd wakes up, and to which it then
+ * frees pages, set by the -kswapd-low and -kswapd-high kernel options.
+ * A low watermark of 0 turns kswapd off. */
+extern size_t kswapd_low;
+extern size_t kswapd_high;
+
+void kswapd_init (void);
+void kswapd_check (bool got_frame);
+void kswapd_print_stats (void);
+
+/* For kswapd.c, in vm.c. */
+size_t vm_reclaim (size_t cnt);
+
+#endif  /* VM_KSWAPD_H */
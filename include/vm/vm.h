@@ -1,6 +1,10 @@
 #ifndef VM_VM_H
 #define VM_VM_H
 #include <stdbool.h>
+#include <hash.h>
+#include <list.h>
+#include <radix.h>
+#include <rbtree.h>
 #include "threads/palloc.h"
 
 enum vm_type {
@@ -27,15 +31,16 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
-#ifdef EFILESYS
 #include "filesys/page_cache.h"
-#endif
 
 struct page_operations;
 struct thread;
 
 #define VM_TYPE(type) ((type) & 7)
 
+/* Marks the area of the user stack, which grows down on demand. */
+#define VM_STACK VM_MARKER_0
+
 /* The representation of "page".
  * This is kind of "parent class", which has four "child class"es, which are
  * uninit_page, file_page, anon_page, and page cache (project4).
@@ -46,6 +51,13 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct vm_area *area;  /* Area that contains the page, or NULL for a
+	                          page of the page cache. */
+	bool huge;             /* Maps a whole 2 MB huge page. */
+	uint64_t evict_stamp;  /* For the replacement policy. */
+	struct page *share_next;  /* Next page sharing FRAME, or NULL. */
+	bool zero;             /* Mapped read-only to the zero page. */
+	bool locked;           /* Kept resident by mlock(). */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -53,16 +65,34 @@ struct page {
 		struct uninit_page uninit;
 		struct anon_page anon;
 		struct file_page file;
-#ifdef EFILESYS
 		struct page_cache page_cache;
-#endif
 	};
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".  After fork(), the pages of
+ * anonymous memory in parent and child share their frames, read-only,
+ * until one of them writes; PAGE is then the first of the pages that
+ * share the frame, chained through their SHARE_NEXT.  A frame of the
+ * page cache is shared by its cache page, which is in no area, and
+ * the pages of file mappings that map it, all writable. */
 struct frame {
 	void *kva;
 	struct page *page;
+
+	/* Your implementation */
+	struct list_elem elem; /* Element in the replacement policy's lists. */
+	int pinned;            /* Pins that keep it from eviction while the
+	                          kernel uses it. */
+	int share_cnt;         /* Number of pages mapped to the frame. */
+	int lock_cnt;          /* ...of them locked by mlock(). */
+	bool cached;           /* Holds a page of the page cache? */
+	int queue;             /* For the replacement policy. */
+	int64_t stamp;         /* For the replacement policy. */
+	struct list_elem ksm_elem;       /* In ksmd's list of frames. */
+	struct hash_elem ksm_hash_elem;  /* In ksmd's table of candidates. */
+	uint64_t ksm_sum;      /* Checksum of the contents, at the last scan. */
+	bool ksm_listed;       /* In ksmd's table of candidates? */
+	bool ksm_merged;       /* Has ksmd merged pages into it? */
 };
 
 /* The function table for page operations.
@@ -81,13 +111,56 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
-/* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+/* A virtual memory area: the pages from START up to END, all of one
+ * type, with one permission and one backing.  The first READ_BYTES
+ * bytes are read from FILE starting at OFFSET and the rest of the area
+ * is zero-filled.
+ *
+ * Areas are what mmap(), the ELF loader and the stack create.  A page
+ * of an area gets a struct page only when it is first faulted in, so
+ * mapping a large file or reserving a large region costs one area, not
+ * one descriptor per 4 kB. */
+struct vm_area {
+	struct rb_node elem;   /* Element in the table's area tree. */
+	void *start;           /* First page. */
+	void *end;             /* One past the last page. */
+	enum vm_type type;     /* VM_ANON or VM_FILE, plus markers. */
+	bool writable;         /* May the user write to it? */
+	int advice;            /* MADV_* given by madvise(). */
+	struct file *file;     /* Backing file, owned by the area, or NULL. */
+	off_t offset;          /* Offset in FILE of START. */
+	size_t read_bytes;     /* Bytes of the area backed by FILE. */
+	struct supplemental_page_table *spt;  /* Table that owns the area. */
+
+	/* Readahead of the part read from FILE, in pages from START. */
+	size_t ra_next;        /* Page a sequential fault would be on. */
+	size_t ra_end;         /* End of the pages already read or asked for. */
+	size_t ra_window;      /* Pages to read ahead next time. */
+
+	struct list_elem file_elem;  /* In file.c's list, if VM_FILE. */
+};
+
+/* Representation of current process's memory space: the areas,
+ * ordered by address, and the pages that have been faulted in so
+ * far, indexed by page number. */
 struct supplemental_page_table {
+	struct rbtree areas;        /* Areas, ordered by START. */
+	struct radix_tree pages;    /* Pages that exist, by page number. */
+	struct vm_area *stack;      /* The stack's area, or NULL. */
+	struct thread *owner;       /* Thread whose address space it is. */
+	size_t locked_cnt;          /* Pages locked by mlock(). */
 };
 
 #include "threads/thread.h"
+
+/* Pages around a fault on a page read from a file that are read in
+ * along with it, set by the -fault-around kernel option. */
+extern size_t fault_around_pages;
+
+/* Most pages of a file read ahead of sequential faults, in the
+ * background, set by the -readahead kernel option. */
+extern size_t readahead_max;
+
 void supplemental_page_table_init (struct supplemental_page_table *spt);
 bool supplemental_page_table_copy (struct supplemental_page_table *dst,
 		struct supplemental_page_table *src);
@@ -96,8 +169,17 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+struct vm_area *spt_find_area (struct supplemental_page_table *spt,
+		const void *va);
+struct vm_area *spt_add_area (struct supplemental_page_table *spt,
+		void *start, void *end, enum vm_type type, bool writable,
+		struct file *file, off_t offset, size_t read_bytes);
+void spt_remove_area (struct supplemental_page_table *spt,
+		struct vm_area *area);
 
 void vm_init (void);
+void vm_lock (void);
+void vm_unlock (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -108,5 +190,17 @@ bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
+bool vm_access_ok (const void *uaddr, bool write);
+bool vm_pin_buffer (const void *buffer, size_t size, bool write);
+void vm_unpin_buffer (const void *buffer, size_t size);
+bool vm_madvise (void *addr, size_t length, int advice);
+bool vm_mlock (void *addr, size_t length, bool lock);
+void vm_print_stats (void);
+bool vm_area_read_page (struct page *page, void *kva);
+
+off_t vm_file_read_at (struct file *file, void *buffer, off_t size,
+		off_t ofs);
+off_t vm_file_write_at (struct file *file, const void *buffer, off_t size,
+		off_t ofs);
 
 #endif  /* VM_VM_H */
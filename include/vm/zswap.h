@@ -0,0 +1,18 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+struct page;
+
+/* Most kernel pages the compressed swap cache may take, set by the
+ * -zswap kernel option.  0 turns the cache off. */
+extern size_t zswap_max_pages;
+
+void zswap_init (void);
+bool zswap_store (struct page *page);
+bool zswap_load (struct page *page, void *kva);
+void zswap_invalidate (struct page *page);
+void zswap_print_stats (void);
+
+#endif  /* VM_ZSWAP_H */
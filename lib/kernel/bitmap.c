@@ -4,6 +4,7 @@
 #include <round.h>
 #include <stdio.h>
 #include "threads/malloc.h"
+#include "intrinsic.h"
 #ifdef FILESYS
 #include "filesys/file.h"
 #endif
@@ -63,6 +64,75 @@ last_mask (const struct bitmap *b) {
 	return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns an elem_type with the bits from START up to END,
+   exclusive, turned on, where START and END are bit positions
+   within one element and START < END <= ELEM_BITS. */
+static inline elem_type
+range_mask (size_t start, size_t end) {
+	elem_type high = end < ELEM_BITS ? ((elem_type) 1 << end) - 1 : (elem_type) -1;
+	return high & ~(((elem_type) 1 << start) - 1);
+}
+
+/* Returns an elem_type whose bits are on where E's are VALUE. */
+static inline elem_type
+match (elem_type e, bool value) {
+	return value ? e : ~e;
+}
+
+/* Returns the number of bits set in E, using the POPCNT
+   instruction if the CPU has it. */
+static inline size_t
+popcount (elem_type e) {
+	static int has_popcnt = -1;
+
+	if (has_popcnt < 0) {
+		uint32_t eax, ebx, ecx, edx;
+		cpuid (1, 0, &eax, &ebx, &ecx, &edx);
+		has_popcnt = (ecx >> 23) & 1;
+	}
+
+	if (has_popcnt) {
+		elem_type cnt;
+		asm ("popcnt %1, %0" : "=r" (cnt) : "rm" (e) : "cc");
+		return cnt;
+	}
+
+	/* Sum adjacent bits, then pairs, then nibbles, then bytes. */
+	e = e - ((e >> 1) & 0x5555555555555555UL);
+	e = (e & 0x3333333333333333UL) + ((e >> 2) & 0x3333333333333333UL);
+	e = (e + (e >> 4)) & 0x0f0f0f0f0f0f0f0fUL;
+	return (e * 0x0101010101010101UL) >> 56;
+}
+
+/* Returns the index of the first bit in B at or after START, and
+   before END, that is set to VALUE, or END if there is none. */
+static size_t
+find_next (const struct bitmap *b, size_t start, size_t end, bool value) {
+	size_t idx = elem_idx (start);
+	elem_type e;
+
+	if (start >= end)
+		return end;
+
+	e = match (b->bits[idx], value) & ~(bit_mask (start) - 1);
+	while (e == 0) {
+		if (++idx >= elem_cnt (end))
+			return end;
+		e = match (b->bits[idx], value);
+	}
+
+	start = idx * ELEM_BITS + __builtin_ctzl (e);
+	return start < end ? start : end;
+}
+
+/* Returns the number of bits from START up to START + CNT,
+   exclusive, that lie in the same element as START. */
+static inline size_t
+chunk_len (size_t start, size_t cnt) {
+	size_t room = ELEM_BITS - start % ELEM_BITS;
+	return room < cnt ? room : cnt;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -197,30 +267,47 @@ bitmap_set_all (struct bitmap *b, bool value) {
 /* Sets the CNT bits starting at START in B to VALUE. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		bitmap_set (b, start + i, value);
+	/* One atomic OR or AND per element, as in bitmap_mark() and
+	   bitmap_reset(). */
+	while (cnt > 0) {
+		size_t len = chunk_len (start, cnt);
+		size_t ofs = start % ELEM_BITS;
+		elem_type *e = &b->bits[elem_idx (start)];
+		elem_type mask = range_mask (ofs, ofs + len);
+
+		if (value)
+			asm ("lock orq %1, %0" : "+m" (*e) : "r" (mask) : "cc");
+		else
+			asm ("lock andq %1, %0" : "+m" (*e) : "r" (~mask) : "cc");
+		start += len;
+		cnt -= len;
+	}
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i, value_cnt;
+	size_t value_cnt;
 
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
 	value_cnt = 0;
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			value_cnt++;
+	while (cnt > 0) {
+		size_t len = chunk_len (start, cnt);
+		size_t ofs = start % ELEM_BITS;
+		elem_type e = match (b->bits[elem_idx (start)], value);
+
+		value_cnt += popcount (e & range_mask (ofs, ofs + len));
+		start += len;
+		cnt -= len;
+	}
 	return value_cnt;
 }
 
@@ -228,16 +315,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) {
    exclusive, are set to VALUE, and false otherwise. */
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) {
-	size_t i;
-
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 	ASSERT (start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test (b, start + i) == value)
-			return true;
-	return false;
+	return find_next (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -272,12 +354,26 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
+	if (cnt == 0)
+		return start;
 	if (cnt <= b->bit_cnt) {
 		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains (b, i, cnt, !value))
+		size_t i = start;
+
+		/* Jump to the next bit set to VALUE, then look for a bit
+		   set to !VALUE within CNT bits of it.  If there is one, no
+		   group can start before it, so resume the search there. */
+		while (i <= last) {
+			size_t end;
+
+			i = find_next (b, i, last + 1, value);
+			if (i > last)
+				break;
+			end = find_next (b, i, i + cnt, !value);
+			if (end == i + cnt)
 				return i;
+			i = end;
+		}
 	}
 	return BITMAP_ERROR;
 }
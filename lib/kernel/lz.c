@@ -0,0 +1,175 @@
+/* LZ compression.
+
+   The compressed form is a series of sequences.  Each starts with a
+   token byte whose high 4 bits give the number of literal bytes
+   that follow it and whose low 4 bits give the length of the match
+   after them, less LZ_MIN_MATCH.  A field of 15 means that the
+   length goes on in the bytes that follow, each added to it, up to
+   and including the first that is not 255.  Then come the literals,
+   and then the match: the distance back to its start in the output,
+   2 bytes little-endian, and the rest of its length, if any.  The
+   last sequence has only literals, and ends the input.
+
+   See lz.h for basic information. */
+
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+#include "../debug.h"
+
+#define LZ_MIN_MATCH 4              /* Shortest match. */
+#define LZ_MAX_OFFSET 65535         /* Farthest match. */
+
+/* Returns the 4 bytes at P as an integer. */
+static inline uint32_t
+read32 (const uint8_t *p) {
+	uint32_t v;
+	memcpy (&v, p, sizeof v);
+	return v;
+}
+
+/* Returns the hash table index for the 4 bytes V. */
+static inline unsigned
+hash4 (uint32_t v) {
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends to *OP, below OEND, the bytes that carry on a length LEN
+   whose token field is 15.  Returns false if they do not fit. */
+static bool
+put_len (uint8_t **op, const uint8_t *oend, size_t len) {
+	if (len < 15)
+		return true;
+	for (len -= 15; ; len -= 255) {
+		if (*op >= oend)
+			return false;
+		if (len < 255) {
+			*(*op)++ = len;
+			return true;
+		}
+		*(*op)++ = 255;
+	}
+}
+
+/* Adds to *LEN, whose token field was 15, the bytes at *IP, below
+   IEND, that carry it on.  Returns false if the input ends first. */
+static bool
+get_len (const uint8_t **ip, const uint8_t *iend, size_t *len) {
+	uint8_t b;
+
+	if (*len < 15)
+		return true;
+	do {
+		if (*ip >= iend)
+			return false;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return true;
+}
+
+/* Appends to *OP, below OEND, a sequence of the LIT_LEN literals at
+   LIT followed, unless MATCH_LEN is 0, by a match of MATCH_LEN bytes
+   starting OFFSET bytes back.  Returns false if it does not fit. */
+static bool
+put_sequence (uint8_t **op, const uint8_t *oend, const uint8_t *lit,
+		size_t lit_len, size_t offset, size_t match_len) {
+	size_t rest = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+
+	if (*op >= oend)
+		return false;
+	*(*op)++ = (lit_len < 15 ? lit_len : 15) << 4 | (rest < 15 ? rest : 15);
+	if (!put_len (op, oend, lit_len) || (size_t) (oend - *op) < lit_len)
+		return false;
+	memcpy (*op, lit, lit_len);
+	*op += lit_len;
+
+	if (match_len > 0) {
+		if (oend - *op < 2)
+			return false;
+		*(*op)++ = offset & 0xff;
+		*(*op)++ = offset >> 8;
+		if (!put_len (op, oend, rest))
+			return false;
+	}
+	return true;
+}
+
+/* Compresses the SRC_LEN bytes at SRC into DST, which has room for
+   DST_CAP bytes, using the LZ_WORK_SIZE bytes at WORK as scratch.
+   Returns the size of the compressed data, or 0 if it would not fit
+   in DST_CAP bytes. */
+size_t
+lz_compress (const void *src_, size_t src_len, void *dst, size_t dst_cap,
+		void *work) {
+	const uint8_t *src = src_, *end = src + src_len;
+	const uint8_t *ip = src, *anchor = src;
+	uint8_t *op = dst, *oend = op + dst_cap;
+	uint16_t *table = work;
+
+	ASSERT (src_len <= LZ_MAX_INPUT);
+
+	memset (table, 0, LZ_WORK_SIZE);
+	while (end - ip >= LZ_MIN_MATCH) {
+		uint32_t v = read32 (ip);
+		unsigned h = hash4 (v);
+		const uint8_t *ref = src + table[h];
+
+		table[h] = ip - src;
+		if (ref < ip && ip - ref <= LZ_MAX_OFFSET && read32 (ref) == v) {
+			const uint8_t *m = ip + LZ_MIN_MATCH, *r = ref + LZ_MIN_MATCH;
+
+			while (m < end && *m == *r)
+				m++, r++;
+			if (!put_sequence (&op, oend, anchor, ip - anchor, ip - ref,
+						m - ip))
+				return 0;
+			ip = anchor = m;
+		} else
+			ip++;
+	}
+	if (!put_sequence (&op, oend, anchor, end - anchor, 0, 0))
+		return 0;
+	return op - (uint8_t *) dst;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC, made by lz_compress(), into
+   the DST_LEN bytes at DST.  Returns true if successful, false if
+   the input is corrupt or does not decompress to exactly DST_LEN
+   bytes. */
+bool
+lz_decompress (const void *src, size_t src_len, void *dst_, size_t dst_len) {
+	const uint8_t *ip = src, *iend = ip + src_len;
+	uint8_t *dst = dst_, *op = dst, *oend = dst + dst_len;
+
+	while (ip < iend) {
+		unsigned token = *ip++;
+		size_t len = token >> 4, offset;
+
+		/* Literals. */
+		if (!get_len (&ip, iend, &len)
+				|| (size_t) (iend - ip) < len || (size_t) (oend - op) < len)
+			return false;
+		memcpy (op, ip, len);
+		op += len;
+		ip += len;
+		if (ip == iend)
+			break;
+
+		/* Match, which may overlap its own output. */
+		if (iend - ip < 2)
+			return false;
+		offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		len = token & 15;
+		if (!get_len (&ip, iend, &len))
+			return false;
+		len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > (size_t) (op - dst)
+				|| (size_t) (oend - op) < len)
+			return false;
+		for (; len > 0; len--, op++)
+			*op = op[-offset];
+	}
+	return op == oend;
+}
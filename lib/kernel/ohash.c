@@ -0,0 +1,486 @@
+/* Open-addressing hash table.
+
+   See ohash.h for basic information. */
+
+#include "ohash.h"
+#include <string.h>
+#include "../debug.h"
+#include "threads/malloc.h"
+
+/* Slots per group: one control tag per byte of a word. */
+#define GROUP_SLOTS 8
+
+/* Control tags.  A full slot holds the low 7 bits of its element's
+   hash, so its high bit is clear. */
+#define CTRL_EMPTY 0x80         /* Never used, or freed: ends probes. */
+#define CTRL_DELETED 0xfe       /* Freed: probes continue past it. */
+
+/* A group's eight control tags with every byte set to 0x01 or to
+   0x80. */
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+/* Groups moved from the old table to the new one per operation
+   while growing. */
+#define MIGRATE_GROUPS 2
+
+/* Groups in a new table. */
+#define MIN_GROUPS 2
+
+static struct ohash_elem *find_elem (struct ohash *, struct ohash_elem *,
+		struct ohash_table **, size_t *slot);
+static bool place_elem (struct ohash *, struct ohash_table *,
+		struct ohash_elem *);
+static void remove_slot (struct ohash_table *, size_t slot);
+static void make_room (struct ohash *);
+static void migrate (struct ohash *, size_t group_cnt);
+static bool table_init (struct ohash_table *, size_t group_cnt);
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX. */
+bool
+ohash_init (struct ohash *h,
+		ohash_hash_func *hash, ohash_less_func *less, void *aux) {
+	h->elem_cnt = 0;
+	h->old.group_cnt = 0;
+	h->migrated = 0;
+	h->hash = hash;
+	h->less = less;
+	h->aux = aux;
+	return table_init (&h->cur, MIN_GROUPS);
+}
+
+/* Removes all the elements from H.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+   memory used by the hash element.  However, modifying hash
+   table H while ohash_clear() is running, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), yields undefined behavior,
+   whether done in DESTRUCTOR or elsewhere. */
+void
+ohash_clear (struct ohash *h, ohash_action_func *destructor) {
+	if (destructor != NULL)
+		ohash_apply (h, destructor);
+
+	if (h->old.group_cnt != 0) {
+		free (h->old.ctrl);
+		h->old.group_cnt = 0;
+	}
+	memset (h->cur.ctrl, CTRL_EMPTY, h->cur.group_cnt * GROUP_SLOTS);
+	h->cur.used = 0;
+	h->elem_cnt = 0;
+}
+
+/* Destroys hash table H.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash, as in ohash_clear(). */
+void
+ohash_destroy (struct ohash *h, ohash_action_func *destructor) {
+	ohash_clear (h, destructor);
+	free (h->cur.ctrl);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW.
+   If the table is full and cannot grow for lack of memory,
+   returns NEW without inserting it. */
+struct ohash_elem *
+ohash_insert (struct ohash *h, struct ohash_elem *new) {
+	struct ohash_elem *old;
+
+	new->hash = h->hash (new, h->aux);
+	migrate (h, MIGRATE_GROUPS);
+
+	old = find_elem (h, new, NULL, NULL);
+	if (old == NULL) {
+		make_room (h);
+		if (!place_elem (h, &h->cur, new))
+			return new;
+	}
+	return old;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned.
+   If the table is full and cannot grow for lack of memory,
+   returns NEW without inserting it. */
+struct ohash_elem *
+ohash_replace (struct ohash *h, struct ohash_elem *new) {
+	struct ohash_table *t;
+	struct ohash_elem *old;
+	size_t slot;
+
+	new->hash = h->hash (new, h->aux);
+	migrate (h, MIGRATE_GROUPS);
+
+	old = find_elem (h, new, &t, &slot);
+	if (old != NULL && t == &h->cur) {
+		/* Same hash, so the same tag: just swap the pointer. */
+		t->slots[slot] = new;
+		return old;
+	}
+	if (old != NULL) {
+		remove_slot (t, slot);
+		h->elem_cnt--;
+	}
+
+	make_room (h);
+	if (!place_elem (h, &h->cur, new)) {
+		/* Only possible if OLD was not found, so nothing is lost. */
+		return new;
+	}
+	return old;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct ohash_elem *
+ohash_find (struct ohash *h, struct ohash_elem *e) {
+	e->hash = h->hash (e, h->aux);
+	migrate (h, MIGRATE_GROUPS);
+	return find_elem (h, e, NULL, NULL);
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.
+
+   If the elements of the hash table are dynamically allocated,
+   or own resources that are, then it is the caller's
+   responsibility to deallocate them. */
+struct ohash_elem *
+ohash_delete (struct ohash *h, struct ohash_elem *e) {
+	struct ohash_table *t;
+	struct ohash_elem *found;
+	size_t slot;
+
+	e->hash = h->hash (e, h->aux);
+	migrate (h, MIGRATE_GROUPS);
+
+	found = find_elem (h, e, &t, &slot);
+	if (found != NULL) {
+		remove_slot (t, slot);
+		h->elem_cnt--;
+	}
+	return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.
+   Modifying hash table H while ohash_apply() is running, using
+   any of the functions ohash_clear(), ohash_destroy(),
+   ohash_insert(), ohash_replace(), or ohash_delete(), yields
+   undefined behavior, whether done from ACTION or elsewhere. */
+void
+ohash_apply (struct ohash *h, ohash_action_func *action) {
+	struct ohash_iterator i;
+
+	ASSERT (action != NULL);
+
+	ohash_first (&i, h);
+	while (ohash_next (&i))
+		action (ohash_cur (&i), h->aux);
+}
+
+/* Initializes I for iterating hash table H, with the same idiom
+   as hash_first().
+
+   Modifying hash table H during iteration, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), ohash_find(), or ohash_delete(), invalidates
+   all iterators.  ohash_find() is included because it may move
+   elements from the old table to the new one. */
+void
+ohash_first (struct ohash_iterator *i, struct ohash *h) {
+	ASSERT (i != NULL);
+	ASSERT (h != NULL);
+
+	i->hash = h;
+	i->table = &h->cur;
+	i->slot = (size_t) -1;
+	i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order. */
+struct ohash_elem *
+ohash_next (struct ohash_iterator *i) {
+	ASSERT (i != NULL);
+
+	for (;;) {
+		struct ohash_table *t = i->table;
+
+		while (++i->slot < t->group_cnt * GROUP_SLOTS)
+			if (!(t->ctrl[i->slot] & 0x80))
+				return i->elem = t->slots[i->slot];
+
+		if (t != &i->hash->cur || i->hash->old.group_cnt == 0)
+			return i->elem = NULL;
+		i->table = &i->hash->old;
+		i->slot = (size_t) -1;
+	}
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling ohash_first() but before ohash_next(). */
+struct ohash_elem *
+ohash_cur (struct ohash_iterator *i) {
+	return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ohash_size (struct ohash *h) {
+	return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *h) {
+	return h->elem_cnt == 0;
+}
+
+/* Returns the control tag for a slot holding an element with hash
+   value HASH. */
+static inline uint8_t
+hash_tag (uint64_t hash) {
+	return hash & 0x7f;
+}
+
+/* Returns the group where the probe for hash value HASH starts in
+   T.  The tag uses the low bits, so the group uses the high ones. */
+static inline size_t
+hash_group (const struct ohash_table *t, uint64_t hash) {
+	return (hash >> 7) & (t->group_cnt - 1);
+}
+
+/* Returns the control tags of group G in T as a word. */
+static inline uint64_t
+group_word (const struct ohash_table *t, size_t g) {
+	uint64_t w;
+	memcpy (&w, t->ctrl + g * GROUP_SLOTS, sizeof w);
+	return w;
+}
+
+/* Returns a word with the high bit set in each byte of W equal to
+   TAG.  A byte just above a match may be flagged too, so callers
+   check the flagged tags again. */
+static inline uint64_t
+match_tag (uint64_t w, uint8_t tag) {
+	uint64_t x = w ^ (ONES * tag);
+	return (x - ONES) & ~x & HIGHS;
+}
+
+/* Returns a word with the high bit set in each byte of W that is
+   CTRL_EMPTY: high bit set and bit 1 clear, unlike CTRL_DELETED. */
+static inline uint64_t
+match_empty (uint64_t w) {
+	return w & ~(w << 6) & HIGHS;
+}
+
+/* Returns a word with the high bit set in each byte of W that is
+   CTRL_EMPTY or CTRL_DELETED. */
+static inline uint64_t
+match_free (uint64_t w) {
+	return w & HIGHS;
+}
+
+/* Returns the slot in group G of the lowest byte flagged in
+   MATCH, a nonzero result of the match functions above. */
+static inline size_t
+match_slot (size_t g, uint64_t match) {
+	return g * GROUP_SLOTS + __builtin_ctzll (match) / 8;
+}
+
+/* Searches T for an element equal to E, which has its hash cached.
+   Returns its slot or (size_t) -1 if there is none.  Groups are
+   probed in triangular order, which visits each of them once when
+   the group count is a power of 2, and the probe ends at the
+   first group with an empty slot. */
+static size_t
+find_slot (struct ohash *h, struct ohash_table *t, struct ohash_elem *e) {
+	uint8_t tag = hash_tag (e->hash);
+	size_t g = hash_group (t, e->hash);
+	size_t step;
+
+	for (step = 1; step <= t->group_cnt; step++) {
+		uint64_t w = group_word (t, g);
+		uint64_t match;
+
+		for (match = match_tag (w, tag); match != 0; match &= match - 1) {
+			size_t slot = match_slot (g, match);
+			struct ohash_elem *ei = t->slots[slot];
+
+			if (t->ctrl[slot] == tag && ei->hash == e->hash
+					&& !h->less (ei, e, h->aux) && !h->less (e, ei, h->aux))
+				return slot;
+		}
+		if (match_empty (w) != 0)
+			break;
+		g = (g + step) & (t->group_cnt - 1);
+	}
+	return (size_t) -1;
+}
+
+/* Searches H for an element equal to E, which has its hash cached,
+   and returns it, or a null pointer if there is none.  If found
+   and TABLE is non-null, stores the table and slot that hold it
+   in *TABLE and *SLOT. */
+static struct ohash_elem *
+find_elem (struct ohash *h, struct ohash_elem *e,
+		struct ohash_table **table, size_t *slot) {
+	struct ohash_table *tables[] = { &h->cur, &h->old };
+
+	for (size_t i = 0; i < 2; i++) {
+		struct ohash_table *t = tables[i];
+		size_t s;
+
+		if (t->group_cnt == 0)
+			continue;
+		s = find_slot (h, t, e);
+		if (s != (size_t) -1) {
+			if (table != NULL) {
+				*table = t;
+				*slot = s;
+			}
+			return t->slots[s];
+		}
+	}
+	return NULL;
+}
+
+/* Puts E, which has its hash cached and is not yet in H, into the
+   first free slot on its probe sequence in T.  Returns false if T
+   has no free slot. */
+static bool
+place_elem (struct ohash *h, struct ohash_table *t, struct ohash_elem *e) {
+	size_t g = hash_group (t, e->hash);
+	size_t step;
+
+	for (step = 1; step <= t->group_cnt; step++) {
+		uint64_t match = match_free (group_word (t, g));
+
+		if (match != 0) {
+			size_t slot = match_slot (g, match);
+
+			if (t->ctrl[slot] == CTRL_EMPTY)
+				t->used++;
+			t->ctrl[slot] = hash_tag (e->hash);
+			t->slots[slot] = e;
+			h->elem_cnt++;
+			return true;
+		}
+		g = (g + step) & (t->group_cnt - 1);
+	}
+	return false;
+}
+
+/* Frees SLOT in T.  A probe stops at the first group with an
+   empty slot, so if SLOT's group already has one, no element lies
+   beyond it on a probe through this group and SLOT can be made
+   empty too.  Otherwise it must only be marked deleted. */
+static void
+remove_slot (struct ohash_table *t, size_t slot) {
+	size_t g = slot / GROUP_SLOTS;
+
+	if (match_empty (group_word (t, g)) != 0) {
+		t->ctrl[slot] = CTRL_EMPTY;
+		t->used--;
+	} else
+		t->ctrl[slot] = CTRL_DELETED;
+}
+
+/* Returns the number of full or deleted slots above which T is
+   grown: 7/8 of its slots, as in Swiss tables. */
+static inline size_t
+max_used (const struct ohash_table *t) {
+	return t->group_cnt * GROUP_SLOTS / 8 * 7;
+}
+
+/* Makes sure H's current table can take one more element without
+   exceeding its load limit, starting to move H into a new table if
+   needed.  If memory for the new table is not available, the
+   current table keeps going until it is completely full. */
+static void
+make_room (struct ohash *h) {
+	struct ohash_table new;
+	size_t group_cnt;
+
+	if (h->cur.used + 1 <= max_used (&h->cur))
+		return;
+
+	/* A growth started earlier has to finish first. */
+	migrate (h, h->old.group_cnt);
+
+	/* Double the table if the elements themselves fill over half of
+	   it; otherwise the load is mostly deleted slots, and a table of
+	   the same size drops them. */
+	group_cnt = h->cur.group_cnt;
+	if (h->elem_cnt + 1 > max_used (&h->cur) / 2)
+		group_cnt *= 2;
+	if (!table_init (&new, group_cnt))
+		return;
+
+	h->old = h->cur;
+	h->cur = new;
+	h->migrated = 0;
+	migrate (h, MIGRATE_GROUPS);
+}
+
+/* Moves the elements in up to GROUP_CNT more groups of H's old
+   table into its current table, and frees the old table once it
+   is empty.  Moved slots are marked deleted, so that probes in the
+   old table still pass over them. */
+static void
+migrate (struct ohash *h, size_t group_cnt) {
+	struct ohash_table *old = &h->old;
+
+	if (old->group_cnt == 0)
+		return;
+
+	for (; group_cnt > 0 && h->migrated < old->group_cnt; group_cnt--) {
+		size_t slot = h->migrated++ * GROUP_SLOTS;
+		size_t end = slot + GROUP_SLOTS;
+
+		for (; slot < end; slot++)
+			if (!(old->ctrl[slot] & 0x80)) {
+				bool ok UNUSED;
+
+				old->ctrl[slot] = CTRL_DELETED;
+				h->elem_cnt--;
+				ok = place_elem (h, &h->cur, old->slots[slot]);
+				ASSERT (ok);
+			}
+	}
+
+	if (h->migrated == old->group_cnt) {
+		free (old->ctrl);
+		old->group_cnt = 0;
+	}
+}
+
+/* Initializes T as an empty table of GROUP_CNT groups.  The tags
+   and the slots share one allocation, starting at T->ctrl.
+   Returns false if memory allocation fails. */
+static bool
+table_init (struct ohash_table *t, size_t group_cnt) {
+	size_t slot_cnt = group_cnt * GROUP_SLOTS;
+	uint8_t *block = malloc (slot_cnt + slot_cnt * sizeof *t->slots);
+
+	if (block == NULL)
+		return false;
+
+	memset (block, CTRL_EMPTY, slot_cnt);
+	t->group_cnt = group_cnt;
+	t->used = 0;
+	t->ctrl = block;
+	t->slots = (struct ohash_elem **) (block + slot_cnt);
+	return true;
+}
@@ -0,0 +1,178 @@
+/* Pairing heap.
+
+   A heap-ordered multiway tree: each element is not less than its
+   parent.  The children of an element form a doubly linked list
+   through `next' and `prev', where the first child's `prev' points
+   to the parent.  Removing the root merges its children pairwise
+   from left to right and then folds the pairs from right to left,
+   the "two-pass" variant of Fredman, Sedgewick, Sleator, and
+   Tarjan, "The pairing heap: A new form of self-adjusting heap".
+
+   See pheap.h for basic information. */
+
+#include "pheap.h"
+#include "../debug.h"
+
+static struct pheap_elem *meld (struct pheap *, struct pheap_elem *,
+		struct pheap_elem *);
+static struct pheap_elem *merge_pairs (struct pheap *, struct pheap_elem *);
+static void detach (struct pheap_elem *);
+
+/* Initializes H as an empty heap ordered by LESS, given auxiliary
+   data AUX. */
+void
+pheap_init (struct pheap *h, pheap_less_func *less, void *aux) {
+	ASSERT (h != NULL);
+	ASSERT (less != NULL);
+
+	h->root = NULL;
+	h->elem_cnt = 0;
+	h->less = less;
+	h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+pheap_push (struct pheap *h, struct pheap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	e->child = e->next = e->prev = NULL;
+	h->root = meld (h, h->root, e);
+	h->elem_cnt++;
+}
+
+/* Returns the least element in H, without removing it, or a null
+   pointer if H is empty. */
+struct pheap_elem *
+pheap_top (const struct pheap *h) {
+	return h->root;
+}
+
+/* Removes and returns the least element in H, or returns a null
+   pointer if H is empty. */
+struct pheap_elem *
+pheap_pop (struct pheap *h) {
+	struct pheap_elem *top = h->root;
+
+	if (top != NULL) {
+		h->root = merge_pairs (h, top->child);
+		h->elem_cnt--;
+	}
+	return top;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+pheap_remove (struct pheap *h, struct pheap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	if (e == h->root) {
+		pheap_pop (h);
+		return;
+	}
+
+	detach (e);
+	h->root = meld (h, h->root, merge_pairs (h, e->child));
+	h->elem_cnt--;
+}
+
+/* Restores the order of H after the value of E, which is in H,
+   has decreased, for example because a thread's priority was
+   raised in a heap whose least element is the most urgent. */
+void
+pheap_decrease (struct pheap *h, struct pheap_elem *e) {
+	ASSERT (h != NULL);
+	ASSERT (e != NULL);
+
+	if (e == h->root)
+		return;
+
+	/* E's subtree is still ordered; only E's link to its parent may
+	   be wrong, so cut it out and meld it back in. */
+	detach (e);
+	e->next = e->prev = NULL;
+	h->root = meld (h, h->root, e);
+}
+
+/* Returns the number of elements in H. */
+size_t
+pheap_size (const struct pheap *h) {
+	return h->elem_cnt;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+pheap_empty (const struct pheap *h) {
+	return h->root == NULL;
+}
+
+/* Combines the heaps rooted at A and B, either of which may be
+   null, and returns the root of the result: the lesser root
+   gains the other as its first child.  On a tie A stays on top. */
+static struct pheap_elem *
+meld (struct pheap *h, struct pheap_elem *a, struct pheap_elem *b) {
+	if (a == NULL)
+		return b;
+	if (b == NULL)
+		return a;
+	if (h->less (b, a, h->aux)) {
+		struct pheap_elem *tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != NULL)
+		a->child->prev = b;
+	a->child = b;
+	a->next = a->prev = NULL;
+	return a;
+}
+
+/* Melds the list of sibling heaps starting at FIRST into one and
+   returns its root, or a null pointer if FIRST is null. */
+static struct pheap_elem *
+merge_pairs (struct pheap *h, struct pheap_elem *first) {
+	struct pheap_elem *pairs = NULL;
+
+	/* First pass, left to right: meld each pair and push the
+	   result on a stack linked through `next'. */
+	while (first != NULL) {
+		struct pheap_elem *a = first;
+		struct pheap_elem *b = a->next;
+		struct pheap_elem *pair;
+
+		first = b != NULL ? b->next : NULL;
+		a->next = a->prev = NULL;
+		if (b != NULL)
+			b->next = b->prev = NULL;
+		pair = meld (h, a, b);
+		pair->next = pairs;
+		pairs = pair;
+	}
+
+	/* Second pass, right to left: fold the stack into one heap. */
+	first = NULL;
+	while (pairs != NULL) {
+		struct pheap_elem *next = pairs->next;
+		pairs->next = NULL;
+		first = meld (h, pairs, first);
+		pairs = next;
+	}
+	return first;
+}
+
+/* Unlinks E, which is in a heap but is not its root, from its
+   parent and siblings.  E keeps its children. */
+static void
+detach (struct pheap_elem *e) {
+	if (e->prev->child == e)
+		e->prev->child = e->next;
+	else
+		e->prev->next = e->next;
+	if (e->next != NULL)
+		e->next->prev = e->prev;
+}
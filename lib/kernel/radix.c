@@ -0,0 +1,375 @@
+/* Radix tree.
+
+   A node at level SHIFT indexes its slots with bits SHIFT up to
+   SHIFT + RADIX_BITS of the key; the bottom nodes have SHIFT 0 and
+   hold the entries themselves.  The root's SHIFT determines the
+   largest key the tree can hold; the tree grows a level at the
+   top when a larger key is inserted, and drops levels when only
+   the first slot of the root is left in use.
+
+   See radix.h for basic information. */
+
+#include "radix.h"
+#include "../debug.h"
+#include "threads/malloc.h"
+
+static struct radix_node *node_create (struct radix_tree *,
+		struct radix_node *parent, unsigned offset, unsigned shift);
+static void prune (struct radix_tree *, struct radix_node *);
+static void destroy_node (struct radix_node *, uint64_t base,
+		radix_action_func *, void *aux);
+static struct radix_node *find_bottom (const struct radix_tree *,
+		uint64_t key);
+
+/* Returns the largest key that a subtree rooted at a node at level
+   SHIFT can hold, relative to the start of its range. */
+static inline uint64_t
+span_max (unsigned shift) {
+	return shift + RADIX_BITS >= 64 ? UINT64_MAX
+		: ((uint64_t) 1 << (shift + RADIX_BITS)) - 1;
+}
+
+/* Returns the slot of KEY in a node at level SHIFT. */
+static inline unsigned
+slot_of (uint64_t key, unsigned shift) {
+	return (key >> shift) & (RADIX_SLOTS - 1);
+}
+
+/* Initializes T as an empty tree. */
+void
+radix_init (struct radix_tree *t) {
+	ASSERT (t != NULL);
+
+	t->root = NULL;
+	t->entry_cnt = 0;
+	t->node_cnt = 0;
+}
+
+/* Frees all the nodes of T, leaving it empty.  If ACTION is
+   non-null, it is first called on each entry in key order, given
+   auxiliary data AUX, and may free it. */
+void
+radix_destroy (struct radix_tree *t, radix_action_func *action, void *aux) {
+	if (t->root != NULL)
+		destroy_node (t->root, 0, action, aux);
+	radix_init (t);
+}
+
+/* Makes KEY map to ITEM, which must not be null, in T.  Returns
+   true if successful, false if KEY is already in T or if memory
+   allocation failed. */
+bool
+radix_insert (struct radix_tree *t, uint64_t key, void *item) {
+	struct radix_node *n;
+	unsigned slot;
+
+	ASSERT (t != NULL);
+	ASSERT (item != NULL);
+
+	/* Make the tree tall enough for KEY. */
+	if (t->root == NULL) {
+		unsigned shift = 0;
+
+		while (key > span_max (shift))
+			shift += RADIX_BITS;
+		t->root = node_create (t, NULL, 0, shift);
+		if (t->root == NULL)
+			return false;
+	}
+	while (key > span_max (t->root->shift)) {
+		struct radix_node *old = t->root;
+		struct radix_node *new = node_create (t, NULL, 0,
+				old->shift + RADIX_BITS);
+
+		if (new == NULL)
+			return false;
+		new->slots[0] = old;
+		new->present = 1;
+		for (int tag = 0; tag < RADIX_TAG_CNT; tag++)
+			new->tags[tag] = old->tags[tag] != 0;
+		old->parent = new;
+		t->root = new;
+	}
+
+	/* Walk down, creating the missing nodes. */
+	n = t->root;
+	while (n->shift > 0) {
+		struct radix_node *child;
+
+		slot = slot_of (key, n->shift);
+		child = n->slots[slot];
+		if (child == NULL) {
+			child = node_create (t, n, slot, n->shift - RADIX_BITS);
+			if (child == NULL) {
+				prune (t, n);
+				return false;
+			}
+			n->slots[slot] = child;
+			n->present |= (uint64_t) 1 << slot;
+		}
+		n = child;
+	}
+
+	slot = slot_of (key, 0);
+	if (n->slots[slot] != NULL)
+		return false;
+	n->slots[slot] = item;
+	n->present |= (uint64_t) 1 << slot;
+	t->entry_cnt++;
+	return true;
+}
+
+/* Returns the entry for KEY in T, or a null pointer if there is
+   none. */
+void *
+radix_lookup (const struct radix_tree *t, uint64_t key) {
+	struct radix_node *n = find_bottom (t, key);
+
+	return n != NULL ? n->slots[slot_of (key, 0)] : NULL;
+}
+
+/* Removes the entry for KEY, with its tags, from T and returns it,
+   or returns a null pointer if there is none.  Nodes left empty
+   are freed. */
+void *
+radix_delete (struct radix_tree *t, uint64_t key) {
+	struct radix_node *n = find_bottom (t, key);
+	unsigned slot = slot_of (key, 0);
+	void *item;
+
+	if (n == NULL || (item = n->slots[slot]) == NULL)
+		return NULL;
+
+	for (int tag = 0; tag < RADIX_TAG_CNT; tag++)
+		radix_tag_clear (t, key, tag);
+	n->slots[slot] = NULL;
+	n->present &= ~((uint64_t) 1 << slot);
+	t->entry_cnt--;
+	prune (t, n);
+
+	/* Drop levels whose root only uses its first slot. */
+	while (t->root != NULL && t->root->shift > 0
+			&& t->root->present == 1) {
+		struct radix_node *old = t->root;
+
+		t->root = old->slots[0];
+		t->root->parent = NULL;
+		t->root->offset = 0;
+		free (old);
+		t->node_cnt--;
+	}
+	return item;
+}
+
+/* Sets TAG on the entry for KEY in T.  Returns false if KEY is not
+   in T. */
+bool
+radix_tag_set (struct radix_tree *t, uint64_t key, enum radix_tag tag) {
+	struct radix_node *n = find_bottom (t, key);
+	unsigned slot = slot_of (key, 0);
+
+	ASSERT (tag >= 0 && tag < RADIX_TAG_CNT);
+
+	if (n == NULL || n->slots[slot] == NULL)
+		return false;
+
+	/* Mark the path up to the first node that already has it. */
+	for (; n != NULL; slot = n->offset, n = n->parent) {
+		uint64_t bit = (uint64_t) 1 << slot;
+
+		if (n->tags[tag] & bit)
+			break;
+		n->tags[tag] |= bit;
+	}
+	return true;
+}
+
+/* Clears TAG on the entry for KEY in T, if there is one. */
+void
+radix_tag_clear (struct radix_tree *t, uint64_t key, enum radix_tag tag) {
+	struct radix_node *n = find_bottom (t, key);
+	unsigned slot = slot_of (key, 0);
+
+	ASSERT (tag >= 0 && tag < RADIX_TAG_CNT);
+
+	/* Unmark the path up to the first node that still has another
+	   tagged slot. */
+	for (; n != NULL; slot = n->offset, n = n->parent) {
+		n->tags[tag] &= ~((uint64_t) 1 << slot);
+		if (n->tags[tag] != 0)
+			break;
+	}
+}
+
+/* Returns true if the entry for KEY in T has TAG. */
+bool
+radix_tag_get (const struct radix_tree *t, uint64_t key, enum radix_tag tag) {
+	struct radix_node *n = find_bottom (t, key);
+
+	ASSERT (tag >= 0 && tag < RADIX_TAG_CNT);
+
+	return n != NULL && (n->tags[tag] >> slot_of (key, 0)) & 1;
+}
+
+/* Returns the entry in T with the least key from *KEY through
+   LAST, inclusive, that has TAG, or any entry if TAG is RADIX_ANY,
+   and stores its key in *KEY.  Returns a null pointer if there is
+   none.  The entries in a range are visited with
+
+   uint64_t key = first;
+   for (item = radix_next (t, &key, last, tag); item != NULL;
+        item = key < last ? (key++, radix_next (t, &key, last, tag)) : NULL)
+     ...do something with item...
+*/
+void *
+radix_next (const struct radix_tree *t, uint64_t *key, uint64_t last,
+		enum radix_tag tag) {
+	uint64_t start = *key;
+
+	ASSERT (tag == RADIX_ANY || (tag >= 0 && tag < RADIX_TAG_CNT));
+
+	if (t->root == NULL)
+		return NULL;
+
+	while (start <= last && start <= span_max (t->root->shift)) {
+		struct radix_node *n = t->root;
+
+		for (;;) {
+			unsigned slot = slot_of (start, n->shift);
+			uint64_t mask = n->present & (UINT64_MAX << slot);
+
+			if (tag != RADIX_ANY)
+				mask &= n->tags[tag];
+
+			if (mask == 0) {
+				/* Nothing left under N: skip past the rest of its
+				   range and search again from the top. */
+				uint64_t span = span_max (n->shift);
+				if ((start | span) == UINT64_MAX)
+					return NULL;
+				start = (start | span) + 1;
+				break;
+			}
+
+			if ((unsigned) __builtin_ctzll (mask) != slot) {
+				/* Move to the start of the next used slot. */
+				slot = __builtin_ctzll (mask);
+				start = (start & ~span_max (n->shift))
+					| ((uint64_t) slot << n->shift);
+				if (start > last)
+					return NULL;
+			}
+
+			if (n->shift == 0) {
+				*key = start;
+				return n->slots[slot];
+			}
+			n = n->slots[slot];
+		}
+	}
+	return NULL;
+}
+
+/* Stores up to MAX entries of T, in key order, with keys at least
+   FIRST and with TAG, or any entries if TAG is RADIX_ANY, into
+   ITEMS, and their keys into KEYS if it is non-null.  Returns the
+   number of entries stored. */
+size_t
+radix_gang_lookup (const struct radix_tree *t, uint64_t first, size_t max,
+		void **items, uint64_t *keys, enum radix_tag tag) {
+	uint64_t key = first;
+	size_t cnt = 0;
+
+	while (cnt < max) {
+		void *item = radix_next (t, &key, UINT64_MAX, tag);
+
+		if (item == NULL)
+			break;
+		items[cnt] = item;
+		if (keys != NULL)
+			keys[cnt] = key;
+		cnt++;
+		if (key == UINT64_MAX)
+			break;
+		key++;
+	}
+	return cnt;
+}
+
+/* Returns the number of entries in T. */
+size_t
+radix_size (const struct radix_tree *t) {
+	return t->entry_cnt;
+}
+
+/* Returns the number of bytes of memory used by T's nodes. */
+size_t
+radix_footprint (const struct radix_tree *t) {
+	return t->node_cnt * sizeof (struct radix_node);
+}
+
+/* Allocates an empty node at level SHIFT in T, in slot OFFSET of
+   PARENT.  Returns a null pointer if memory allocation fails. */
+static struct radix_node *
+node_create (struct radix_tree *t, struct radix_node *parent,
+		unsigned offset, unsigned shift) {
+	struct radix_node *n = calloc (1, sizeof *n);
+
+	if (n != NULL) {
+		n->parent = parent;
+		n->offset = offset;
+		n->shift = shift;
+		t->node_cnt++;
+	}
+	return n;
+}
+
+/* Frees N and then its ancestors in T as long as they are left
+   with no slots in use.  Empty nodes have no tags, so the tag
+   summaries above stay correct. */
+static void
+prune (struct radix_tree *t, struct radix_node *n) {
+	while (n != NULL && n->present == 0) {
+		struct radix_node *parent = n->parent;
+
+		if (parent != NULL) {
+			parent->slots[n->offset] = NULL;
+			parent->present &= ~((uint64_t) 1 << n->offset);
+		} else
+			t->root = NULL;
+		free (n);
+		t->node_cnt--;
+		n = parent;
+	}
+}
+
+/* Calls ACTION on the entries under N, whose range starts at BASE,
+   if ACTION is non-null, and frees N and the nodes under it. */
+static void
+destroy_node (struct radix_node *n, uint64_t base,
+		radix_action_func *action, void *aux) {
+	for (unsigned slot = 0; slot < RADIX_SLOTS; slot++) {
+		uint64_t key = base | ((uint64_t) slot << n->shift);
+
+		if (n->slots[slot] == NULL)
+			continue;
+		if (n->shift > 0)
+			destroy_node (n->slots[slot], key, action, aux);
+		else if (action != NULL)
+			action (key, n->slots[slot], aux);
+	}
+	free (n);
+}
+
+/* Returns the bottom node of T that would hold KEY, or a null
+   pointer if there is none. */
+static struct radix_node *
+find_bottom (const struct radix_tree *t, uint64_t key) {
+	struct radix_node *n = t->root;
+
+	if (n == NULL || key > span_max (n->shift))
+		return NULL;
+	while (n != NULL && n->shift > 0)
+		n = n->slots[slot_of (key, n->shift)];
+	return n;
+}
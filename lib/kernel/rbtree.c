@@ -0,0 +1,384 @@
+/* Red-black tree.
+
+   The balancing follows [CLRS] chapter 13, "Red-Black Trees",
+   with null pointers standing in for the black leaves.
+
+   See rbtree.h for basic information. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void rotate_left (struct rbtree *, struct rb_node *);
+static void rotate_right (struct rbtree *, struct rb_node *);
+static void insert_fixup (struct rbtree *, struct rb_node *);
+static void remove_fixup (struct rbtree *, struct rb_node *,
+		struct rb_node *parent);
+static void transplant (struct rbtree *, struct rb_node *,
+		struct rb_node *);
+
+/* Initializes T as an empty tree ordered by LESS, given auxiliary
+   data AUX. */
+void
+rb_init (struct rbtree *t, rb_less_func *less, void *aux) {
+	ASSERT (t != NULL);
+	ASSERT (less != NULL);
+
+	t->root = NULL;
+	t->node_cnt = 0;
+	t->less = less;
+	t->aux = aux;
+}
+
+/* Inserts N into T, after any nodes equal to it. */
+void
+rb_insert (struct rbtree *t, struct rb_node *n) {
+	struct rb_node *parent = NULL;
+	struct rb_node **link = &t->root;
+
+	ASSERT (t != NULL);
+	ASSERT (n != NULL);
+
+	while (*link != NULL) {
+		parent = *link;
+		link = t->less (n, parent, t->aux) ? &parent->left : &parent->right;
+	}
+
+	n->parent = parent;
+	n->left = n->right = NULL;
+	n->red = true;
+	*link = n;
+	t->node_cnt++;
+
+	insert_fixup (t, n);
+}
+
+/* Removes N, which must be in T, from T. */
+void
+rb_remove (struct rbtree *t, struct rb_node *n) {
+	struct rb_node *child, *parent;
+	bool removed_red = n->red;
+
+	ASSERT (t != NULL);
+	ASSERT (n != NULL);
+
+	if (n->left == NULL) {
+		child = n->right;
+		parent = n->parent;
+		transplant (t, n, child);
+	} else if (n->right == NULL) {
+		child = n->left;
+		parent = n->parent;
+		transplant (t, n, child);
+	} else {
+		/* Put N's successor, which has no left child, in N's place. */
+		struct rb_node *succ = n->right;
+
+		while (succ->left != NULL)
+			succ = succ->left;
+		removed_red = succ->red;
+		child = succ->right;
+
+		if (succ->parent == n)
+			parent = succ;
+		else {
+			parent = succ->parent;
+			transplant (t, succ, child);
+			succ->right = n->right;
+			succ->right->parent = succ;
+		}
+		transplant (t, n, succ);
+		succ->left = n->left;
+		succ->left->parent = succ;
+		succ->red = n->red;
+	}
+	t->node_cnt--;
+
+	if (!removed_red)
+		remove_fixup (t, child, parent);
+}
+
+/* Returns the least node in T, or a null pointer if T is
+   empty. */
+struct rb_node *
+rb_first (const struct rbtree *t) {
+	struct rb_node *n = t->root;
+
+	if (n != NULL)
+		while (n->left != NULL)
+			n = n->left;
+	return n;
+}
+
+/* Returns the greatest node in T, or a null pointer if T is
+   empty. */
+struct rb_node *
+rb_last (const struct rbtree *t) {
+	struct rb_node *n = t->root;
+
+	if (n != NULL)
+		while (n->right != NULL)
+			n = n->right;
+	return n;
+}
+
+/* Returns the node that follows N in its tree, or a null pointer
+   if N is the last one. */
+struct rb_node *
+rb_next (const struct rb_node *n) {
+	ASSERT (n != NULL);
+
+	if (n->right != NULL) {
+		n = n->right;
+		while (n->left != NULL)
+			n = n->left;
+		return (struct rb_node *) n;
+	}
+	while (n->parent != NULL && n == n->parent->right)
+		n = n->parent;
+	return n->parent;
+}
+
+/* Returns the node that precedes N in its tree, or a null
+   pointer if N is the first one. */
+struct rb_node *
+rb_prev (const struct rb_node *n) {
+	ASSERT (n != NULL);
+
+	if (n->left != NULL) {
+		n = n->left;
+		while (n->right != NULL)
+			n = n->right;
+		return (struct rb_node *) n;
+	}
+	while (n->parent != NULL && n == n->parent->left)
+		n = n->parent;
+	return n->parent;
+}
+
+/* Returns a node in T equal to KEY, or a null pointer if there is
+   none.  If several are equal, returns the first of them. */
+struct rb_node *
+rb_find (const struct rbtree *t, const struct rb_node *key) {
+	struct rb_node *n = rb_lower_bound (t, key);
+
+	return n != NULL && !t->less (key, n, t->aux) ? n : NULL;
+}
+
+/* Returns the first node in T that is not less than KEY, or a
+   null pointer if there is none. */
+struct rb_node *
+rb_lower_bound (const struct rbtree *t, const struct rb_node *key) {
+	struct rb_node *n = t->root, *bound = NULL;
+
+	while (n != NULL)
+		if (t->less (n, key, t->aux))
+			n = n->right;
+		else {
+			bound = n;
+			n = n->left;
+		}
+	return bound;
+}
+
+/* Returns the first node in T that is greater than KEY, or a null
+   pointer if there is none. */
+struct rb_node *
+rb_upper_bound (const struct rbtree *t, const struct rb_node *key) {
+	struct rb_node *n = t->root, *bound = NULL;
+
+	while (n != NULL)
+		if (t->less (key, n, t->aux)) {
+			bound = n;
+			n = n->left;
+		} else
+			n = n->right;
+	return bound;
+}
+
+/* Returns the last node in T that is not greater than KEY, or a
+   null pointer if there is none.  For a tree of non-overlapping
+   ranges ordered by their start, this is the only range that can
+   contain KEY's start. */
+struct rb_node *
+rb_floor (const struct rbtree *t, const struct rb_node *key) {
+	struct rb_node *n = t->root, *bound = NULL;
+
+	while (n != NULL)
+		if (t->less (key, n, t->aux))
+			n = n->left;
+		else {
+			bound = n;
+			n = n->right;
+		}
+	return bound;
+}
+
+/* Returns the number of nodes in T. */
+size_t
+rb_size (const struct rbtree *t) {
+	return t->node_cnt;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (const struct rbtree *t) {
+	return t->root == NULL;
+}
+
+/* Returns true if N is red.  The null leaves are black. */
+static inline bool
+is_red (const struct rb_node *n) {
+	return n != NULL && n->red;
+}
+
+/* Replaces the subtree rooted at OLD in T by the one rooted at NEW,
+   which may be null, as far as OLD's parent is concerned. */
+static void
+transplant (struct rbtree *t, struct rb_node *old, struct rb_node *new) {
+	if (old->parent == NULL)
+		t->root = new;
+	else if (old == old->parent->left)
+		old->parent->left = new;
+	else
+		old->parent->right = new;
+	if (new != NULL)
+		new->parent = old->parent;
+}
+
+/* Makes N's right child take N's place in T, with N as its left
+   child. */
+static void
+rotate_left (struct rbtree *t, struct rb_node *n) {
+	struct rb_node *r = n->right;
+
+	n->right = r->left;
+	if (r->left != NULL)
+		r->left->parent = n;
+	transplant (t, n, r);
+	r->left = n;
+	n->parent = r;
+}
+
+/* Makes N's left child take N's place in T, with N as its right
+   child. */
+static void
+rotate_right (struct rbtree *t, struct rb_node *n) {
+	struct rb_node *l = n->left;
+
+	n->left = l->right;
+	if (l->right != NULL)
+		l->right->parent = n;
+	transplant (t, n, l);
+	l->right = n;
+	n->parent = l;
+}
+
+/* Restores the red-black properties after red node N was
+   inserted into T. */
+static void
+insert_fixup (struct rbtree *t, struct rb_node *n) {
+	while (is_red (n->parent)) {
+		struct rb_node *parent = n->parent;
+		struct rb_node *grand = parent->parent;
+
+		if (parent == grand->left) {
+			struct rb_node *uncle = grand->right;
+
+			if (is_red (uncle)) {
+				parent->red = uncle->red = false;
+				grand->red = true;
+				n = grand;
+				continue;
+			}
+			if (n == parent->right) {
+				rotate_left (t, parent);
+				n = parent;
+				parent = n->parent;
+			}
+			parent->red = false;
+			grand->red = true;
+			rotate_right (t, grand);
+		} else {
+			struct rb_node *uncle = grand->left;
+
+			if (is_red (uncle)) {
+				parent->red = uncle->red = false;
+				grand->red = true;
+				n = grand;
+				continue;
+			}
+			if (n == parent->left) {
+				rotate_right (t, parent);
+				n = parent;
+				parent = n->parent;
+			}
+			parent->red = false;
+			grand->red = true;
+			rotate_left (t, grand);
+		}
+	}
+	t->root->red = false;
+}
+
+/* Restores the red-black properties after a black node was
+   removed from T.  N, which may be null, took its place as a child
+   of PARENT and is short one black node on its paths. */
+static void
+remove_fixup (struct rbtree *t, struct rb_node *n, struct rb_node *parent) {
+	while (n != t->root && !is_red (n)) {
+		if (n == parent->left) {
+			struct rb_node *sib = parent->right;
+
+			if (is_red (sib)) {
+				sib->red = false;
+				parent->red = true;
+				rotate_left (t, parent);
+				sib = parent->right;
+			}
+			if (!is_red (sib->left) && !is_red (sib->right)) {
+				sib->red = true;
+				n = parent;
+				parent = n->parent;
+				continue;
+			}
+			if (!is_red (sib->right)) {
+				sib->left->red = false;
+				sib->red = true;
+				rotate_right (t, sib);
+				sib = parent->right;
+			}
+			sib->red = parent->red;
+			parent->red = false;
+			sib->right->red = false;
+			rotate_left (t, parent);
+		} else {
+			struct rb_node *sib = parent->left;
+
+			if (is_red (sib)) {
+				sib->red = false;
+				parent->red = true;
+				rotate_right (t, parent);
+				sib = parent->left;
+			}
+			if (!is_red (sib->left) && !is_red (sib->right)) {
+				sib->red = true;
+				n = parent;
+				parent = n->parent;
+				continue;
+			}
+			if (!is_red (sib->left)) {
+				sib->right->red = false;
+				sib->red = true;
+				rotate_left (t, sib);
+				sib = parent->left;
+			}
+			sib->red = parent->red;
+			parent->red = false;
+			sib->left->red = false;
+			rotate_right (t, parent);
+		}
+		n = t->root;
+	}
+	if (n != NULL)
+		n->red = false;
+}
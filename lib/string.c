@@ -1,5 +1,95 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* The block routines below move and compare memory a machine word
+   at a time.  Copies and fills use the string instructions, which
+   the CPU runs in large chunks internally: bytes up to the first
+   word-aligned destination address, then words with `rep movsq' or
+   `rep stosq', then the remaining bytes.  Blocks shorter than
+   WORD_MIN go byte by byte, since setting up the words would cost
+   more than it saves. */
+
+#define WORD_MIN 32
+
+/* A word that may alias any other type. */
+typedef uint64_t __attribute__ ((__may_alias__)) word_t;
+
+/* Word with every byte set to 0x01 or to 0x80. */
+#define ONES 0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+/* Returns a word whose high bit is set in each byte that is zero
+   in W.  Only the lowest set bit is exact: a byte just above a
+   zero byte may be flagged as well.  See "Determine if a word has a
+   zero byte" in Sean Anderson's "Bit Twiddling Hacks". */
+static inline uint64_t
+zero_bytes (uint64_t w) {
+	return (w - ONES) & ~w & HIGHS;
+}
+
+/* Returns the index of the lowest byte flagged in MASK, a nonzero
+   result of zero_bytes(). */
+static inline size_t
+first_flagged (uint64_t mask) {
+	return __builtin_ctzll (mask) / 8;
+}
+
+/* Copies CNT bytes from *SRC to *DST upward, advancing both. */
+static inline void
+movsb (unsigned char **dst, const unsigned char **src, size_t cnt) {
+	asm volatile ("rep movsb"
+			: "+D" (*dst), "+S" (*src), "+c" (cnt) : : "memory");
+}
+
+/* Copies CNT words from *SRC to *DST upward, advancing both. */
+static inline void
+movsq (unsigned char **dst, const unsigned char **src, size_t cnt) {
+	asm volatile ("rep movsq"
+			: "+D" (*dst), "+S" (*src), "+c" (cnt) : : "memory");
+}
+
+/* Copies SIZE bytes from SRC to DST upward. */
+static void
+copy_up (unsigned char *dst, const unsigned char *src, size_t size) {
+	if (size >= WORD_MIN) {
+		size_t head = -(uintptr_t) dst % sizeof (word_t);
+
+		movsb (&dst, &src, head);
+		size -= head;
+		movsq (&dst, &src, size / sizeof (word_t));
+		size %= sizeof (word_t);
+	}
+	movsb (&dst, &src, size);
+}
+
+/* Copies SIZE bytes from SRC to DST downward, starting from the
+   last byte, so that DST may overlap the upper part of SRC: the
+   odd bytes at the top first, then whole words.  The direction flag is set only for the duration of the copy; the
+   interrupt entry code clears it for handlers. */
+static void
+copy_down (unsigned char *dst, const unsigned char *src, size_t size) {
+	size_t tail = size % sizeof (word_t);
+	size_t words = size / sizeof (word_t);
+
+	if (size < WORD_MIN) {
+		tail = size;
+		words = 0;
+	}
+
+	dst += size - 1;
+	src += size - 1;
+	asm volatile ("std\n\t"
+			"rep movsb\n\t"
+			"sub $7, %%rdi\n\t"
+			"sub $7, %%rsi\n\t"
+			"mov %3, %%rcx\n\t"
+			"rep movsq\n\t"
+			"cld"
+			: "+D" (dst), "+S" (src), "+c" (tail)
+			: "r" (words)
+			: "memory", "cc");
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -11,8 +101,7 @@ memcpy (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	while (size-- > 0)
-		*dst++ = *src++;
+	copy_up (dst, src, size);
 
 	return dst_;
 }
@@ -27,17 +116,12 @@ memmove (void *dst_, const void *src_, size_t size) {
 	ASSERT (dst != NULL || size == 0);
 	ASSERT (src != NULL || size == 0);
 
-	if (dst < src) {
-		while (size-- > 0)
-			*dst++ = *src++;
-	} else {
-		dst += size;
-		src += size;
-		while (size-- > 0)
-			*--dst = *--src;
-	}
+	if (dst <= src || dst >= src + size)
+		copy_up (dst, src, size);
+	else
+		copy_down (dst, src, size);
 
-	return dst;
+	return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -52,6 +136,13 @@ memcmp (const void *a_, const void *b_, size_t size) {
 	ASSERT (a != NULL || size == 0);
 	ASSERT (b != NULL || size == 0);
 
+	/* Skip the equal words; the bytes of the first unequal word
+	   are compared below. */
+	for (; size >= sizeof (word_t); a += sizeof (word_t),
+			b += sizeof (word_t), size -= sizeof (word_t))
+		if (*(const word_t *) a != *(const word_t *) b)
+			break;
+
 	for (; size-- > 0; a++, b++)
 		if (*a != *b)
 			return *a > *b ? +1 : -1;
@@ -86,9 +177,22 @@ void *
 memchr (const void *block_, int ch_, size_t size) {
 	const unsigned char *block = block_;
 	unsigned char ch = ch_;
+	uint64_t pattern = ONES * ch;
 
 	ASSERT (block != NULL || size == 0);
 
+	for (; size > 0 && (uintptr_t) block % sizeof (word_t); size--, block++)
+		if (*block == ch)
+			return (void *) block;
+
+	/* XORing with PATTERN turns the bytes equal to CH into zeros. */
+	for (; size >= sizeof (word_t); size -= sizeof (word_t),
+			block += sizeof (word_t)) {
+		uint64_t mask = zero_bytes (*(const word_t *) block ^ pattern);
+		if (mask != 0)
+			return (void *) (block + first_flagged (mask));
+	}
+
 	for (; size-- > 0; block++)
 		if (*block == ch)
 			return (void *) block;
@@ -260,8 +364,21 @@ memset (void *dst_, int value, size_t size) {
 
 	ASSERT (dst != NULL || size == 0);
 
-	while (size-- > 0)
-		*dst++ = value;
+	if (size >= WORD_MIN) {
+		size_t head = -(uintptr_t) dst % sizeof (word_t);
+		size_t words;
+
+		asm volatile ("rep stosb"
+				: "+D" (dst), "+c" (head) : "a" (value) : "memory");
+		size -= -(uintptr_t) dst_ % sizeof (word_t);
+		words = size / sizeof (word_t);
+		asm volatile ("rep stosq"
+				: "+D" (dst), "+c" (words)
+				: "a" (ONES * (unsigned char) value) : "memory");
+		size %= sizeof (word_t);
+	}
+	asm volatile ("rep stosb"
+			: "+D" (dst), "+c" (size) : "a" (value) : "memory");
 
 	return dst_;
 }
@@ -273,9 +390,17 @@ strlen (const char *string) {
 
 	ASSERT (string);
 
-	for (p = string; *p != '\0'; p++)
-		continue;
-	return p - string;
+	for (p = string; (uintptr_t) p % sizeof (word_t); p++)
+		if (*p == '\0')
+			return p - string;
+
+	/* An aligned word never straddles a page boundary, so reading
+	   past the terminator within it cannot fault. */
+	for (;; p += sizeof (word_t)) {
+		uint64_t mask = zero_bytes (*(const word_t *) p);
+		if (mask != 0)
+			return p - string + first_flagged (mask);
+	}
 }
 
 /* If STRING is less than MAXLEN characters in length, returns
@@ -0,0 +1,122 @@
+/* Test program for lib/kernel/lz.c.
+
+   Compresses and decompresses inputs of many sizes with different
+   amounts of redundancy, checking that each comes back intact and
+   that compression fails cleanly when the output does not fit.
+   Reports the ratio reached on each kind of input.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <lz.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/test.h"
+
+/* Largest input tried. */
+#define MAX_SIZE 4096
+
+/* Kinds of input. */
+enum input_kind
+  {
+    ZEROS,                      /* All zero. */
+    TEXT,                       /* Words from a small vocabulary. */
+    SPARSE,                     /* Mostly zero, some random words. */
+    RANDOM,                     /* Random bytes. */
+    KIND_CNT
+  };
+
+static const char *kind_names[KIND_CNT] =
+  { "zeros", "text", "sparse", "random" };
+
+static void make_input (uint8_t *, size_t, enum input_kind);
+
+/* Test the LZ compressor. */
+void
+test (void)
+{
+  static uint16_t work[LZ_WORK_SIZE / sizeof (uint16_t)];
+  static uint8_t in[MAX_SIZE];
+  static uint8_t out[MAX_SIZE * 2];
+  static uint8_t back[MAX_SIZE];
+  enum input_kind kind;
+
+  for (kind = 0; kind < KIND_CNT; kind++)
+    {
+      size_t size, total_in = 0, total_out = 0;
+
+      for (size = 0; size <= MAX_SIZE; size += size < 64 ? 1 : 61)
+        {
+          size_t len;
+
+          make_input (in, size, kind);
+          len = lz_compress (in, size, out, sizeof out, work);
+          ASSERT (len > 0);
+          ASSERT (lz_decompress (out, len, back, size));
+          ASSERT (!memcmp (in, back, size));
+          total_in += size;
+          total_out += len;
+
+          /* Wrong output sizes are caught.  Truncated input either
+             is caught or lost only an empty last sequence. */
+          if (size > 0)
+            ASSERT (!lz_decompress (out, len, back, size - 1));
+          ASSERT (!lz_decompress (out, len, back, size + 1));
+          if (len > 1 && lz_decompress (out, len - 1, back, size))
+            ASSERT (out[len - 1] == 0 && !memcmp (in, back, size));
+
+          /* Compressing into too little room fails. */
+          if (len > 1)
+            ASSERT (lz_compress (in, size, out, len - 1, work) == 0);
+        }
+
+      printf ("%s: %zu bytes compressed to %zu, %zu%%\n", kind_names[kind],
+              total_in, total_out, total_out * 100 / total_in);
+    }
+
+  printf ("lz: PASS\n");
+}
+
+/* Fills the SIZE bytes at BUF with input of the given KIND. */
+static void
+make_input (uint8_t *buf, size_t size, enum input_kind kind)
+{
+  static const char *words[] =
+    { "the ", "page ", "frame ", "swap ", "of ", "a ", "disk ", "table " };
+  size_t i;
+
+  switch (kind)
+    {
+    case ZEROS:
+      memset (buf, 0, size);
+      break;
+    case TEXT:
+      for (i = 0; i < size; )
+        {
+          const char *w = words[random_ulong () % 8];
+          while (*w != '\0' && i < size)
+            buf[i++] = *w++;
+        }
+      break;
+    case SPARSE:
+      memset (buf, 0, size);
+      for (i = 0; i + 8 <= size; i += 8)
+        if (random_ulong () % 16 == 0)
+          {
+            unsigned long v = random_ulong ();
+            memcpy (buf + i, &v, sizeof v < 8 ? sizeof v : 8);
+          }
+      break;
+    case RANDOM:
+      for (i = 0; i < size; i++)
+        buf[i] = random_ulong ();
+      break;
+    default:
+      NOT_REACHED ();
+    }
+}
@@ -0,0 +1,390 @@
+/* Test program for lib/kernel/ohash.c.
+
+   Inserts and deletes elements in random order, with a good hash
+   and with one that puts many elements on the same hash, checking
+   every lookup against a plain array.  Along the way it deletes
+   elements still waiting in the old table of an incremental
+   resize, checks that no operation moves more than a few groups,
+   and checks that deleted slots are used again instead of making
+   the table grow.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <ohash.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Number of elements in each run. */
+#define ELEM_CNT 1024
+
+/* As in ohash.c. */
+#define GROUP_SLOTS 8
+#define MIGRATE_GROUPS 2
+#define CTRL_DELETED 0xfe
+
+/* An element. */
+struct value
+  {
+    struct ohash_elem elem;     /* Hash element. */
+    uint64_t key;               /* Key. */
+    bool in_table;              /* In the table? */
+  };
+
+/* Hash functions to test with. */
+enum hash_kind
+  {
+    GOOD,                       /* Spreads keys over the table. */
+    POOR,                       /* Only 16 hash values. */
+    HASH_KIND_CNT
+  };
+
+static const char *hash_kind_names[HASH_KIND_CNT] = { "good", "poor" };
+
+static struct value values[ELEM_CNT];
+static struct value extra[ELEM_CNT];
+
+/* Elements passed to count_action(). */
+static size_t action_cnt;
+
+static void make_values (struct value[], uint64_t first);
+static void shuffle (int[], size_t);
+static void insert_value (struct ohash *, struct value *);
+static void delete_value (struct ohash *, struct value *);
+static void verify_table (struct ohash *, struct value[]);
+static void delete_unmigrated (struct ohash *);
+static void finish_migration (struct ohash *, struct value[]);
+static void test_tombstones (void);
+static void test_churn (struct ohash *);
+static uint64_t good_hash (const struct ohash_elem *, void *);
+static uint64_t poor_hash (const struct ohash_elem *, void *);
+static uint64_t key_hash (const struct ohash_elem *, void *);
+static bool value_less (const struct ohash_elem *,
+                        const struct ohash_elem *, void *);
+static void count_action (struct ohash_elem *, void *);
+
+/* Test the open-addressing hash table implementation. */
+void
+test (void)
+{
+  enum hash_kind kind;
+
+  for (kind = 0; kind < HASH_KIND_CNT; kind++)
+    {
+      struct ohash h;
+      int order[ELEM_CNT];
+      size_t size;
+      int i;
+
+      make_values (values, 0);
+      make_values (extra, ELEM_CNT);
+      for (i = 0; i < ELEM_CNT; i++)
+        order[i] = i;
+      shuffle (order, ELEM_CNT);
+
+      ASSERT (ohash_init (&h, kind == GOOD ? good_hash : poor_hash,
+                          value_less, NULL));
+
+      /* Insert in random order, through many resizes.  Whenever a
+         resize is under way, delete an element from the part of
+         the old table not yet moved. */
+      for (i = 0; i < ELEM_CNT; i++)
+        {
+          insert_value (&h, &values[order[i]]);
+          if (h.old.group_cnt != 0 && i % 4 == 0)
+            delete_unmigrated (&h);
+          if (i % 16 == 0)
+            verify_table (&h, values);
+        }
+      verify_table (&h, values);
+
+      printf ("%s: %zu elements in %zu groups\n", hash_kind_names[kind],
+              ohash_size (&h), h.cur.group_cnt);
+
+      /* Put back whatever was deleted, then delete half. */
+      for (i = 0; i < ELEM_CNT; i++)
+        if (!values[i].in_table)
+          insert_value (&h, &values[i]);
+      verify_table (&h, values);
+      shuffle (order, ELEM_CNT);
+      for (i = 0; i < ELEM_CNT / 2; i++)
+        {
+          delete_value (&h, &values[order[i]]);
+          if (i % 16 == 0)
+            verify_table (&h, values);
+        }
+      verify_table (&h, values);
+
+      finish_migration (&h, values);
+      test_churn (&h);
+
+      /* Destroy the rest. */
+      size = ohash_size (&h);
+      action_cnt = 0;
+      ohash_clear (&h, count_action);
+      ASSERT (action_cnt == size);
+      ASSERT (ohash_size (&h) == 0);
+      ohash_destroy (&h, NULL);
+    }
+  test_tombstones ();
+
+  printf ("ohash: PASS\n");
+}
+
+/* Fills VALUES with the keys FIRST, FIRST + 1, ..., none of them in
+   a table. */
+static void
+make_values (struct value values[], uint64_t first)
+{
+  int i;
+
+  for (i = 0; i < ELEM_CNT; i++)
+    {
+      values[i].key = first + i;
+      values[i].in_table = false;
+    }
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (int *array, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      int t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Inserts V, which is not in H, checking that a second insertion
+   finds it and that the insertion moves no more than MIGRATE_GROUPS
+   groups of an old table, unless it starts a new resize, which has
+   to finish the last one first. */
+static void
+insert_value (struct ohash *h, struct value *v)
+{
+  size_t old_groups = h->old.group_cnt;
+  size_t migrated = h->migrated;
+  size_t size = ohash_size (h);
+
+  ASSERT (!v->in_table);
+  ASSERT (ohash_insert (h, &v->elem) == NULL);
+  if (old_groups != 0 && h->old.group_cnt != 0 && h->migrated >= migrated)
+    {
+      ASSERT (h->migrated - migrated <= MIGRATE_GROUPS);
+    }
+  ASSERT (ohash_insert (h, &v->elem) == &v->elem);
+  v->in_table = true;
+  ASSERT (ohash_size (h) == size + 1);
+}
+
+/* Deletes V, which is in H. */
+static void
+delete_value (struct ohash *h, struct value *v)
+{
+  size_t size = ohash_size (h);
+
+  ASSERT (v->in_table);
+  ASSERT (ohash_delete (h, &v->elem) == &v->elem);
+  ASSERT (ohash_delete (h, &v->elem) == NULL);
+  v->in_table = false;
+  ASSERT (ohash_size (h) == size - 1);
+}
+
+/* Deletes an element from a group of H's old table that the deletion
+   itself will not move, if there is one. */
+static void
+delete_unmigrated (struct ohash *h)
+{
+  size_t slot;
+
+  for (slot = (h->migrated + MIGRATE_GROUPS) * GROUP_SLOTS;
+       slot < h->old.group_cnt * GROUP_SLOTS; slot++)
+    if (!(h->old.ctrl[slot] & 0x80))
+      {
+        struct value *v = ohash_entry (h->old.slots[slot],
+                                       struct value, elem);
+
+        delete_value (h, v);
+        ASSERT (ohash_find (h, &v->elem) == NULL);
+        return;
+      }
+}
+
+/* Verifies that H holds exactly the elements of VALUES marked
+   in_table, and that iteration visits each of them once. */
+static void
+verify_table (struct ohash *h, struct value values[])
+{
+  struct ohash_iterator i;
+  size_t cnt = 0, seen = 0;
+  int j;
+
+  for (j = 0; j < ELEM_CNT; j++)
+    {
+      struct value *v = &values[j];
+      struct value key;
+
+      key.key = v->key;
+      if (v->in_table)
+        {
+          cnt++;
+          ASSERT (ohash_find (h, &key.elem) == &v->elem);
+        }
+      else
+        ASSERT (ohash_find (h, &key.elem) == NULL);
+    }
+  ASSERT (ohash_size (h) == cnt);
+  ASSERT (ohash_empty (h) == (cnt == 0));
+
+  ohash_first (&i, h);
+  while (ohash_next (&i))
+    {
+      struct value *v = ohash_entry (ohash_cur (&i), struct value, elem);
+
+      ASSERT (v >= values && v < values + ELEM_CNT && v->in_table);
+      seen++;
+    }
+  ASSERT (seen == cnt);
+}
+
+/* Looks up elements in H until it has no old table, each lookup
+   moving a few groups, and verifies that H holds the elements of
+   VALUES marked in_table. */
+static void
+finish_migration (struct ohash *h, struct value values[])
+{
+  struct value key;
+  size_t steps = 0;
+
+  key.key = UINT64_MAX;
+  while (h->old.group_cnt != 0)
+    {
+      ASSERT (ohash_find (h, &key.elem) == NULL);
+      ASSERT (++steps <= ELEM_CNT);
+    }
+  verify_table (h, values);
+}
+
+/* Fills the first group of a new table with elements that all
+   start their probes there, so that it has no empty slot, and
+   checks that the slots deletions leave there are marked deleted
+   and then taken by later insertions, for the same element and for
+   a new one, instead of empty slots elsewhere. */
+static void
+test_tombstones (void)
+{
+  struct ohash h;
+  struct ohash_table *t = &h.cur;
+  size_t used;
+  int i;
+
+  make_values (values, 0);
+  ASSERT (ohash_init (&h, key_hash, value_less, NULL));
+  for (i = 0; i < GROUP_SLOTS; i++)
+    insert_value (&h, &values[i]);
+  ASSERT (h.old.group_cnt == 0);
+  for (i = 0; i < GROUP_SLOTS; i++)
+    ASSERT (t->ctrl[i] == values[i].key);
+  used = t->used;
+
+  /* The same element comes back to its slot. */
+  delete_value (&h, &values[3]);
+  ASSERT (t->ctrl[3] == CTRL_DELETED);
+  ASSERT (t->used == used);
+  insert_value (&h, &values[3]);
+  ASSERT (t->slots[3] == &values[3].elem && t->used == used);
+
+  /* A new element takes the first deleted slot. */
+  delete_value (&h, &values[5]);
+  delete_value (&h, &values[2]);
+  insert_value (&h, &values[GROUP_SLOTS]);
+  ASSERT (t->slots[2] == &values[GROUP_SLOTS].elem);
+  ASSERT (t->ctrl[5] == CTRL_DELETED && t->used == used);
+  verify_table (&h, values);
+
+  action_cnt = 0;
+  ohash_destroy (&h, count_action);
+  ASSERT (action_cnt == GROUP_SLOTS - 1);
+}
+
+/* Replaces elements of H with new ones, one for one, many times over,
+   checking that the deleted slots they leave are reused or dropped
+   without the table growing. */
+static void
+test_churn (struct ohash *h)
+{
+  size_t group_cnt = h->cur.group_cnt;
+  int round;
+
+  for (round = 0; round < 8; round++)
+    {
+      struct value *from = round % 2 == 0 ? values : extra;
+      struct value *to = round % 2 == 0 ? extra : values;
+      int i;
+
+      for (i = 0; i < ELEM_CNT; i++)
+        if (from[i].in_table)
+          {
+            delete_value (h, &from[i]);
+            insert_value (h, &to[i]);
+          }
+      finish_migration (h, to);
+      ASSERT (h->cur.group_cnt == group_cnt);
+    }
+}
+
+/* Returns a hash of V's key that spreads keys over the table. */
+static uint64_t
+good_hash (const struct ohash_elem *e, void *aux UNUSED)
+{
+  const struct value *v = ohash_entry (e, struct value, elem);
+  return v->key * 0x9e3779b97f4a7c15ULL;
+}
+
+/* Returns a hash of V's key that has only 16 values, so that many
+   elements share each one. */
+static uint64_t
+poor_hash (const struct ohash_elem *e, void *aux UNUSED)
+{
+  const struct value *v = ohash_entry (e, struct value, elem);
+  return (v->key % 16) * 0x9e3779b97f4a7c15ULL;
+}
+
+/* Returns V's key as its hash.  Keys below 128 all start their
+   probes in the first group, with the key as their tag. */
+static uint64_t
+key_hash (const struct ohash_elem *e, void *aux UNUSED)
+{
+  return ohash_entry (e, struct value, elem)->key;
+}
+
+/* Returns true if A's key is less than B's. */
+static bool
+value_less (const struct ohash_elem *a_, const struct ohash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = ohash_entry (a_, struct value, elem);
+  const struct value *b = ohash_entry (b_, struct value, elem);
+
+  return a->key < b->key;
+}
+
+/* Counts E in action_cnt and marks its value as out of the table. */
+static void
+count_action (struct ohash_elem *e, void *aux UNUSED)
+{
+  struct value *v = ohash_entry (e, struct value, elem);
+
+  ASSERT (v->in_table);
+  v->in_table = false;
+  action_cnt++;
+}
@@ -0,0 +1,144 @@
+/* Test program for lib/kernel/pheap.c.
+
+   Pushes values in random order and checks that they come out
+   sorted, interleaving removals of arbitrary elements and
+   decreases of their values.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <pheap.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a heap that we will test. */
+#define MAX_SIZE 64
+
+/* A heap element. */
+struct value
+  {
+    struct pheap_elem elem;     /* Heap element. */
+    int value;                  /* Item value. */
+    bool in_heap;               /* In the heap? */
+  };
+
+static void shuffle (struct value[], size_t);
+static bool value_less (const struct pheap_elem *,
+                        const struct pheap_elem *, void *);
+static void verify_pop_all (struct pheap *, struct value[], int size);
+
+/* Test the pairing heap implementation. */
+void
+test (void) 
+{
+  int size;
+
+  printf ("testing various size heaps:");
+  for (size = 0; size < MAX_SIZE; size++) 
+    {
+      int repeat;
+
+      printf (" %d", size);
+      for (repeat = 0; repeat < 10; repeat++) 
+        {
+          static struct value values[MAX_SIZE];
+          struct pheap heap;
+          int i;
+
+          /* Push values in random order, with duplicates. */
+          for (i = 0; i < size; i++)
+            values[i].value = i / 2;
+          shuffle (values, size);
+          pheap_init (&heap, value_less, NULL);
+          for (i = 0; i < size; i++)
+            {
+              pheap_push (&heap, &values[i].elem);
+              values[i].in_heap = true;
+            }
+          ASSERT (pheap_size (&heap) == (size_t) size);
+
+          /* Pop a few to give the heap some structure, then remove
+             some arbitrary elements and lower others. */
+          for (i = 0; i < size / 4; i++)
+            pheap_entry (pheap_pop (&heap), struct value, elem)->in_heap
+              = false;
+          for (i = 0; i < size; i++)
+            if (values[i].in_heap)
+              switch (random_ulong () % 3)
+                {
+                case 0:
+                  pheap_remove (&heap, &values[i].elem);
+                  values[i].in_heap = false;
+                  break;
+                case 1:
+                  values[i].value -= random_ulong () % 8;
+                  pheap_decrease (&heap, &values[i].elem);
+                  break;
+                }
+
+          verify_pop_all (&heap, values, size);
+        }
+    }
+  
+  printf (" done\n");
+  printf ("pheap: PASS\n");
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (struct value *array, size_t cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      struct value t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct pheap_elem *a_, const struct pheap_elem *b_,
+            void *aux UNUSED) 
+{
+  const struct value *a = pheap_entry (a_, struct value, elem);
+  const struct value *b = pheap_entry (b_, struct value, elem);
+  
+  return a->value < b->value;
+}
+
+/* Verifies that popping HEAP until it is empty yields exactly the
+   elements of VALUES[0...SIZE] marked in_heap, in nondecreasing
+   order. */
+static void
+verify_pop_all (struct pheap *heap, struct value values[], int size) 
+{
+  size_t cnt = 0;
+  int i, last = -MAX_SIZE;
+
+  for (i = 0; i < size; i++)
+    cnt += values[i].in_heap;
+  ASSERT (pheap_size (heap) == cnt);
+
+  while (!pheap_empty (heap))
+    {
+      struct pheap_elem *top = pheap_top (heap);
+      struct value *v = pheap_entry (pheap_pop (heap), struct value, elem);
+
+      ASSERT (&v->elem == top);
+      ASSERT (v->in_heap && v->value >= last);
+      v->in_heap = false;
+      last = v->value;
+      cnt--;
+    }
+  ASSERT (cnt == 0);
+  ASSERT (pheap_pop (heap) == NULL);
+}
@@ -0,0 +1,301 @@
+/* Test program for lib/kernel/radix.c.
+
+   Inserts, tags, and deletes entries in random order for dense,
+   sparse, and clustered key sets, checking lookups, tags, and
+   ordered searches against a plain array after each step, and
+   reports how much memory the tree took for each key set.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <radix.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Number of keys in each key set. */
+#define KEY_CNT 512
+
+/* An entry. */
+struct value
+  {
+    uint64_t key;               /* Key. */
+    bool in_tree;               /* In the tree? */
+    bool tagged[RADIX_TAG_CNT]; /* Tags we set. */
+  };
+
+/* Ways of choosing keys. */
+enum key_set
+  {
+    DENSE,                      /* 0, 1, 2, .... */
+    SPARSE,                     /* Random 64-bit keys. */
+    CLUSTERED,                  /* Runs of 32 keys, far apart. */
+    KEY_SET_CNT
+  };
+
+static const char *key_set_names[KEY_SET_CNT] =
+  { "dense", "sparse", "clustered" };
+
+static void make_keys (struct value[], enum key_set);
+static void shuffle (int[], size_t);
+static void verify_tree (struct radix_tree *, struct value[]);
+static struct value *find_next (struct value[], uint64_t first,
+                                uint64_t last, enum radix_tag);
+static void count_action (uint64_t key, void *item, void *aux);
+
+/* Test the radix tree implementation. */
+void
+test (void)
+{
+  static struct value values[KEY_CNT];
+  enum key_set set;
+
+  for (set = 0; set < KEY_SET_CNT; set++)
+    {
+      struct radix_tree tree;
+      int order[KEY_CNT];
+      size_t cnt;
+      int i;
+
+      make_keys (values, set);
+      for (i = 0; i < KEY_CNT; i++)
+        order[i] = i;
+      shuffle (order, KEY_CNT);
+
+      /* Insert in random order, tagging about a third of the
+         entries with each tag. */
+      radix_init (&tree);
+      for (i = 0; i < KEY_CNT; i++)
+        {
+          struct value *v = &values[order[i]];
+          enum radix_tag tag;
+
+          ASSERT (radix_insert (&tree, v->key, v));
+          ASSERT (!radix_insert (&tree, v->key, v));
+          v->in_tree = true;
+          for (tag = 0; tag < RADIX_TAG_CNT; tag++)
+            if (random_ulong () % 3 == 0)
+              {
+                ASSERT (radix_tag_set (&tree, v->key, tag));
+                v->tagged[tag] = true;
+              }
+          if (i % 16 == 0)
+            verify_tree (&tree, values);
+        }
+      verify_tree (&tree, values);
+
+      printf ("%s: %zu entries, %zu nodes, %zu bytes, %zu bytes/entry\n",
+              key_set_names[set], radix_size (&tree),
+              tree.node_cnt, radix_footprint (&tree),
+              radix_footprint (&tree) / radix_size (&tree));
+
+      /* Clear some tags, then delete half the entries. */
+      shuffle (order, KEY_CNT);
+      for (i = 0; i < KEY_CNT / 4; i++)
+        {
+          struct value *v = &values[order[i]];
+
+          radix_tag_clear (&tree, v->key, RADIX_TAG_DIRTY);
+          v->tagged[RADIX_TAG_DIRTY] = false;
+        }
+      verify_tree (&tree, values);
+      shuffle (order, KEY_CNT);
+      for (i = 0; i < KEY_CNT / 2; i++)
+        {
+          struct value *v = &values[order[i]];
+
+          ASSERT (radix_delete (&tree, v->key) == v);
+          ASSERT (radix_delete (&tree, v->key) == NULL);
+          v->in_tree = false;
+          if (i % 16 == 0)
+            verify_tree (&tree, values);
+        }
+      verify_tree (&tree, values);
+
+      /* Destroy the rest. */
+      cnt = 0;
+      radix_destroy (&tree, count_action, &cnt);
+      ASSERT (cnt == KEY_CNT / 2);
+      ASSERT (radix_size (&tree) == 0);
+      ASSERT (radix_footprint (&tree) == 0);
+    }
+
+  printf ("radix: PASS\n");
+}
+
+/* Fills VALUES with distinct keys chosen as SET says. */
+static void
+make_keys (struct value values[], enum key_set set)
+{
+  int i;
+
+  for (i = 0; i < KEY_CNT; i++)
+    {
+      struct value *v = &values[i];
+      int j;
+
+    retry:
+      switch (set)
+        {
+        case DENSE:
+          v->key = i;
+          break;
+        case SPARSE:
+          v->key = ((uint64_t) random_ulong () << 32) ^ random_ulong ();
+          if (i == 0)
+            v->key = UINT64_MAX;
+          break;
+        case CLUSTERED:
+          v->key = (uint64_t) (i / 32) << 36 | (i % 32);
+          break;
+        default:
+          NOT_REACHED ();
+        }
+      for (j = 0; j < i; j++)
+        if (values[j].key == v->key)
+          goto retry;
+
+      v->in_tree = false;
+      for (j = 0; j < RADIX_TAG_CNT; j++)
+        v->tagged[j] = false;
+    }
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (int *array, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      int t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Verifies that TREE holds exactly the entries of VALUES marked
+   in_tree, with the right tags, and checks the ordered searches. */
+static void
+verify_tree (struct radix_tree *tree, struct value values[])
+{
+  size_t cnt = 0;
+  int i, tag;
+
+  for (i = 0; i < KEY_CNT; i++)
+    {
+      struct value *v = &values[i];
+
+      if (v->in_tree)
+        {
+          cnt++;
+          ASSERT (radix_lookup (tree, v->key) == v);
+        }
+      else
+        ASSERT (radix_lookup (tree, v->key) == NULL);
+      for (tag = 0; tag < RADIX_TAG_CNT; tag++)
+        ASSERT (radix_tag_get (tree, v->key, tag)
+                == (v->in_tree && v->tagged[tag]));
+    }
+  ASSERT (radix_size (tree) == cnt);
+  ASSERT ((tree->root == NULL) == (cnt == 0));
+
+  /* Walk every entry, and the entries with each tag, in order, over
+     the whole key space and over a random subrange. */
+  for (tag = RADIX_ANY; tag < RADIX_TAG_CNT; tag++)
+    {
+      uint64_t first = values[random_ulong () % KEY_CNT].key;
+      uint64_t last = values[random_ulong () % KEY_CNT].key;
+      int pass;
+
+      if (first > last)
+        {
+          uint64_t t = first;
+          first = last;
+          last = t;
+        }
+      for (pass = 0; pass < 2; pass++)
+        {
+          uint64_t lo = pass == 0 ? 0 : first;
+          uint64_t hi = pass == 0 ? UINT64_MAX : last;
+          uint64_t key = lo;
+
+          for (;;)
+            {
+              struct value *expect = find_next (values, key, hi, tag);
+              struct value *v = radix_next (tree, &key, hi, tag);
+
+              ASSERT (v == expect);
+              if (v == NULL)
+                break;
+              ASSERT (key == v->key);
+              if (key == hi)
+                break;
+              key++;
+            }
+        }
+    }
+
+  /* Gang lookup returns the same entries in batches. */
+  {
+    void *items[7];
+    uint64_t keys[7];
+    uint64_t key = 0;
+    size_t n, total = 0;
+
+    do
+      {
+        size_t j;
+
+        n = radix_gang_lookup (tree, key, 7, items, keys, RADIX_ANY);
+        for (j = 0; j < n; j++)
+          {
+            ASSERT (items[j] == find_next (values, key, UINT64_MAX,
+                                           RADIX_ANY));
+            ASSERT (keys[j] == ((struct value *) items[j])->key);
+            key = keys[j] + 1;
+          }
+        total += n;
+      }
+    while (n == 7 && key != 0);
+    ASSERT (total == cnt);
+  }
+}
+
+/* Returns the entry of VALUES in the tree with the least key from
+   FIRST through LAST that has TAG, or any entry if TAG is
+   RADIX_ANY, or a null pointer if there is none. */
+static struct value *
+find_next (struct value values[], uint64_t first, uint64_t last,
+           enum radix_tag tag)
+{
+  struct value *best = NULL;
+  int i;
+
+  for (i = 0; i < KEY_CNT; i++)
+    {
+      struct value *v = &values[i];
+
+      if (v->in_tree && v->key >= first && v->key <= last
+          && (tag == RADIX_ANY || v->tagged[tag])
+          && (best == NULL || v->key < best->key))
+        best = v;
+    }
+  return best;
+}
+
+/* Counts the entries passed to it in *AUX, checking their keys. */
+static void
+count_action (uint64_t key, void *item, void *aux)
+{
+  struct value *v = item;
+  size_t *cnt = aux;
+
+  ASSERT (v->in_tree && v->key == key);
+  (*cnt)++;
+}
@@ -0,0 +1,245 @@
+/* Test program for lib/kernel/rbtree.c.
+
+   Inserts and removes values in random order, checking the
+   red-black invariants, in-order traversal, and the search
+   functions after each step.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <rbtree.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of nodes in a tree that we will test. */
+#define MAX_SIZE 64
+
+/* A tree node. */
+struct value
+  {
+    struct rb_node node;        /* Tree node. */
+    int value;                  /* Item value. */
+    bool in_tree;               /* In the tree? */
+  };
+
+static void shuffle (struct value[], size_t);
+static void shuffle_ints (int[], size_t);
+static bool value_less (const struct rb_node *, const struct rb_node *,
+                        void *);
+static int verify_subtree (const struct rb_node *);
+static void verify_tree (struct rbtree *, struct value[], int size);
+
+/* Test the red-black tree implementation. */
+void
+test (void) 
+{
+  int size;
+
+  printf ("testing various size trees:");
+  for (size = 0; size < MAX_SIZE; size++) 
+    {
+      int repeat;
+
+      printf (" %d", size);
+      for (repeat = 0; repeat < 10; repeat++) 
+        {
+          static struct value values[MAX_SIZE];
+          int order[MAX_SIZE];
+          struct rbtree tree;
+          int i;
+
+          /* Put values 0, 2, ..., 2 * (SIZE - 1) in random order in
+             VALUES, so that odd keys fall between nodes. */
+          for (i = 0; i < size; i++)
+            {
+              values[i].value = 2 * i;
+              values[i].in_tree = false;
+            }
+          shuffle (values, size);
+
+          /* Insert them, verifying after each step. */
+          rb_init (&tree, value_less, NULL);
+          for (i = 0; i < size; i++)
+            {
+              rb_insert (&tree, &values[i].node);
+              values[i].in_tree = true;
+              verify_tree (&tree, values, size);
+            }
+
+          /* Remove them in another random order.  The nodes are in
+             the tree, so shuffle their indexes rather than them. */
+          for (i = 0; i < size; i++)
+            order[i] = i;
+          shuffle_ints (order, size);
+          for (i = 0; i < size; i++)
+            {
+              rb_remove (&tree, &values[order[i]].node);
+              values[order[i]].in_tree = false;
+              verify_tree (&tree, values, size);
+            }
+          ASSERT (rb_empty (&tree));
+        }
+    }
+
+  /* Equal keys keep their insertion order. */
+  {
+    static struct value dups[MAX_SIZE];
+    struct rbtree tree;
+    struct rb_node *n;
+    int i;
+
+    rb_init (&tree, value_less, NULL);
+    for (i = 0; i < MAX_SIZE; i++)
+      {
+        dups[i].value = i % 4;
+        rb_insert (&tree, &dups[i].node);
+      }
+    for (i = 0, n = rb_first (&tree); n != NULL; i++, n = rb_next (n))
+      {
+        struct value *v = rb_entry (n, struct value, node);
+        ASSERT (v == &dups[(i % (MAX_SIZE / 4)) * 4 + i / (MAX_SIZE / 4)]);
+      }
+  }
+  
+  printf (" done\n");
+  printf ("rbtree: PASS\n");
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (struct value *array, size_t cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      struct value t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle_ints (int *array, size_t cnt) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      int t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct rb_node *a_, const struct rb_node *b_,
+            void *aux UNUSED) 
+{
+  const struct value *a = rb_entry (a_, struct value, node);
+  const struct value *b = rb_entry (b_, struct value, node);
+  
+  return a->value < b->value;
+}
+
+/* Verifies the parent links and colors of the subtree rooted at N
+   and returns its black height. */
+static int
+verify_subtree (const struct rb_node *n) 
+{
+  int left, right;
+
+  if (n == NULL)
+    return 1;
+  if (n->left != NULL)
+    ASSERT (n->left->parent == n);
+  if (n->right != NULL)
+    ASSERT (n->right->parent == n);
+  if (n->red)
+    ASSERT ((n->left == NULL || !n->left->red)
+            && (n->right == NULL || !n->right->red));
+
+  left = verify_subtree (n->left);
+  right = verify_subtree (n->right);
+  ASSERT (left == right);
+  return left + !n->red;
+}
+
+/* Verifies that TREE is a valid red-black tree that holds, in
+   order, exactly the elements of VALUES[0...SIZE] that are marked
+   in_tree, and checks the search functions. */
+static void
+verify_tree (struct rbtree *tree, struct value values[], int size) 
+{
+  bool present[MAX_SIZE] = { false };
+  struct rb_node *n, *prev;
+  struct value key;
+  size_t cnt = 0;
+  int i, last;
+
+  ASSERT (tree->root == NULL || !tree->root->red);
+  ASSERT (tree->root == NULL || tree->root->parent == NULL);
+  verify_subtree (tree->root);
+
+  for (i = 0; i < size; i++)
+    if (values[i].in_tree)
+      {
+        present[values[i].value / 2] = true;
+        cnt++;
+      }
+  ASSERT (rb_size (tree) == cnt);
+
+  /* Forward and backward traversals. */
+  last = -1;
+  prev = NULL;
+  for (n = rb_first (tree); n != NULL; n = rb_next (n))
+    {
+      struct value *v = rb_entry (n, struct value, node);
+      ASSERT (v->in_tree && v->value > last);
+      ASSERT (rb_prev (n) == prev);
+      last = v->value;
+      prev = n;
+      cnt--;
+    }
+  ASSERT (cnt == 0);
+  ASSERT (rb_last (tree) == prev);
+
+  /* Searches for every key, present or not, and the odd keys in
+     between. */
+  for (key.value = -1; key.value <= 2 * size; key.value++)
+    {
+      int lower = -1, upper = -1, floor = -1;
+
+      for (i = 0; i < size; i++)
+        if (present[i])
+          {
+            if (lower < 0 && 2 * i >= key.value)
+              lower = 2 * i;
+            if (upper < 0 && 2 * i > key.value)
+              upper = 2 * i;
+            if (2 * i <= key.value)
+              floor = 2 * i;
+          }
+
+      n = rb_lower_bound (tree, &key.node);
+      ASSERT (lower < 0 ? n == NULL
+              : rb_entry (n, struct value, node)->value == lower);
+      n = rb_upper_bound (tree, &key.node);
+      ASSERT (upper < 0 ? n == NULL
+              : rb_entry (n, struct value, node)->value == upper);
+      n = rb_floor (tree, &key.node);
+      ASSERT (floor < 0 ? n == NULL
+              : rb_entry (n, struct value, node)->value == floor);
+      n = rb_find (tree, &key.node);
+      ASSERT (lower >= 0 && lower == key.value ? n != NULL : n == NULL);
+    }
+}
@@ -0,0 +1,100 @@
+/* Measures bitmap_scan() and bitmap_count() on a bitmap of 1M
+   bits at several fill levels and checks their results against a
+   bit-at-a-time reference.  This is a benchmark, not a graded
+   test. */
+
+#include <bitmap.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "intrinsic.h"
+
+#define BIT_CNT (1024 * 1024)
+
+/* Finds the first run of CNT bits set to VALUE the slow way. */
+static size_t
+ref_scan (const struct bitmap *b, size_t cnt, bool value)
+{
+  size_t run = 0, i;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    if (bitmap_test (b, i) != value)
+      run = 0;
+    else if (++run == cnt)
+      return i + 1 - cnt;
+  return BITMAP_ERROR;
+}
+
+/* Counts the bits set to VALUE the slow way. */
+static size_t
+ref_count (const struct bitmap *b, bool value)
+{
+  size_t cnt = 0, i;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    cnt += bitmap_test (b, i) == value;
+  return cnt;
+}
+
+/* Sets about PERCENT percent of the bits in B, at random. */
+static void
+fill (struct bitmap *b, unsigned percent)
+{
+  size_t i;
+
+  bitmap_set_all (b, false);
+  for (i = 0; i < bitmap_size (b); i++)
+    if (random_ulong () % 100 < percent)
+      bitmap_mark (b, i);
+}
+
+void
+test_bitmap_bench (void)
+{
+  static const unsigned fills[] = { 0, 50, 90, 99 };
+  static const size_t scan_cnts[] = { 1, 8, 64 };
+  struct bitmap *b = bitmap_create (BIT_CNT);
+  size_t f, c;
+
+  if (b == NULL)
+    fail ("out of memory");
+  random_init (0);
+
+  for (f = 0; f < sizeof fills / sizeof *fills; f++)
+    {
+      uint64_t start, fast, slow;
+      size_t got, want;
+
+      fill (b, fills[f]);
+
+      start = rdtsc ();
+      got = bitmap_count (b, 0, BIT_CNT, true);
+      fast = rdtsc () - start;
+      start = rdtsc ();
+      want = ref_count (b, true);
+      slow = rdtsc () - start;
+      if (got != want)
+        fail ("%u%% full: bitmap_count() returned %zu, expected %zu",
+              fills[f], got, want);
+      msg ("%2u%% full: count %llu cycles, bit by bit %llu cycles",
+           fills[f], fast, slow);
+
+      for (c = 0; c < sizeof scan_cnts / sizeof *scan_cnts; c++)
+        {
+          start = rdtsc ();
+          got = bitmap_scan (b, 0, scan_cnts[c], false);
+          fast = rdtsc () - start;
+          start = rdtsc ();
+          want = ref_scan (b, scan_cnts[c], false);
+          slow = rdtsc () - start;
+          if (got != want)
+            fail ("%u%% full: bitmap_scan(%zu) returned %zu, expected %zu",
+                  fills[f], scan_cnts[c], got, want);
+          msg ("%2u%% full: scan for %2zu free %llu cycles, "
+               "bit by bit %llu cycles", fills[f], scan_cnts[c], fast, slow);
+        }
+    }
+
+  bitmap_destroy (b);
+  pass ();
+}
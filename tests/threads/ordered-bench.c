@@ -0,0 +1,125 @@
+/* Compares the cost of keeping a queue ordered with
+   list_insert_ordered(), a red-black tree, and a pairing heap, as
+   the kernel's priority and sleep queues do: each element is
+   inserted with a random key and then the least one is removed
+   until the queue is empty.  Also checks that all three produce
+   the same order.  This is a benchmark, not a graded test. */
+
+#include <list.h>
+#include <pheap.h>
+#include <random.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "intrinsic.h"
+
+/* An element that can be on all three kinds of queue. */
+struct item
+  {
+    int key;
+    struct list_elem list_elem;
+    struct rb_node rb_node;
+    struct pheap_elem pheap_elem;
+  };
+
+static bool
+list_less (const struct list_elem *a, const struct list_elem *b,
+           void *aux UNUSED)
+{
+  return list_entry (a, struct item, list_elem)->key
+         < list_entry (b, struct item, list_elem)->key;
+}
+
+static bool
+rb_less (const struct rb_node *a, const struct rb_node *b, void *aux UNUSED)
+{
+  return rb_entry (a, struct item, rb_node)->key
+         < rb_entry (b, struct item, rb_node)->key;
+}
+
+static bool
+pheap_less (const struct pheap_elem *a, const struct pheap_elem *b,
+            void *aux UNUSED)
+{
+  return pheap_entry (a, struct item, pheap_elem)->key
+         < pheap_entry (b, struct item, pheap_elem)->key;
+}
+
+/* Runs the three queues on CNT items and reports cycles per
+   insertion and per removal. */
+static void
+bench (struct item *items, int cnt)
+{
+  struct list list;
+  struct rbtree tree;
+  struct pheap heap;
+  uint64_t start, list_ins, list_pop, rb_ins, rb_pop, ph_ins, ph_pop;
+  int i, last;
+
+  for (i = 0; i < cnt; i++)
+    items[i].key = random_ulong () % (cnt * 4);
+
+  list_init (&list);
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    list_insert_ordered (&list, &items[i].list_elem, list_less, NULL);
+  list_ins = rdtsc () - start;
+
+  rb_init (&tree, rb_less, NULL);
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    rb_insert (&tree, &items[i].rb_node);
+  rb_ins = rdtsc () - start;
+
+  pheap_init (&heap, pheap_less, NULL);
+  start = rdtsc ();
+  for (i = 0; i < cnt; i++)
+    pheap_push (&heap, &items[i].pheap_elem);
+  ph_ins = rdtsc () - start;
+
+  start = rdtsc ();
+  while (!list_empty (&list))
+    list_pop_front (&list);
+  list_pop = rdtsc () - start;
+
+  start = rdtsc ();
+  while (!rb_empty (&tree))
+    rb_remove (&tree, rb_first (&tree));
+  rb_pop = rdtsc () - start;
+
+  start = rdtsc ();
+  last = -1;
+  while (!pheap_empty (&heap))
+    {
+      struct item *it = pheap_entry (pheap_pop (&heap), struct item,
+                                     pheap_elem);
+      if (it->key < last)
+        fail ("pairing heap popped %d after %d", it->key, last);
+      last = it->key;
+    }
+  ph_pop = rdtsc () - start;
+
+  msg ("%5d items: list %llu/%llu, rbtree %llu/%llu, pheap %llu/%llu "
+       "cycles per insert/remove", cnt,
+       list_ins / cnt, list_pop / cnt, rb_ins / cnt, rb_pop / cnt,
+       ph_ins / cnt, ph_pop / cnt);
+}
+
+void
+test_ordered_bench (void)
+{
+  static const int cnts[] = { 16, 64, 256, 1024, 4096 };
+  struct item *items = malloc (sizeof *items * 4096);
+  size_t i;
+
+  if (items == NULL)
+    fail ("out of memory");
+  random_init (0);
+
+  for (i = 0; i < sizeof cnts / sizeof *cnts; i++)
+    bench (items, cnts[i]);
+
+  free (items);
+  pass ();
+}
@@ -0,0 +1,110 @@
+/* Measures the throughput of the block routines in lib/string.c
+   on blocks of several sizes and reports it in bytes per cycle,
+   next to a plain byte-at-a-time copy for reference.  This is a
+   benchmark, not a graded test: it always passes. */
+
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+#define BUF_PAGES 17            /* One page of slack for misalignment. */
+#define ROUND_BYTES (1 << 20)   /* Bytes processed per measurement. */
+
+static uint8_t *src, *dst;
+
+/* Copies a byte at a time, as memcpy() used to. */
+static void
+byte_copy (void *dst_, const void *src_, size_t size)
+{
+  uint8_t *d = dst_;
+  const uint8_t *s = src_;
+
+  while (size-- > 0)
+    *d++ = *s++;
+}
+
+enum op { BYTE_COPY, MEMCPY, MEMMOVE, MEMSET, MEMCMP, MEMCHR, STRLEN, OP_CNT };
+
+static const char *op_names[OP_CNT] =
+  { "byte copy", "memcpy", "memmove", "memset", "memcmp", "memchr", "strlen" };
+
+/* Runs OP on SIZE-byte blocks until ROUND_BYTES bytes have been
+   processed and returns the number of cycles taken. */
+static uint64_t
+run (enum op op, size_t size, size_t misalign)
+{
+  uint8_t *d = dst + misalign;
+  const uint8_t *s = src + misalign;
+  size_t i, rounds = ROUND_BYTES / size;
+  volatile size_t sink = 0;
+  uint64_t start;
+
+  memset (dst, 'x', BUF_PAGES * PGSIZE);
+  memset (src, 'x', BUF_PAGES * PGSIZE);
+  dst[misalign + size - 1] = src[misalign + size - 1] = '\0';
+
+  start = rdtsc ();
+  for (i = 0; i < rounds; i++)
+    switch (op)
+      {
+      case BYTE_COPY:
+        byte_copy (d, s, size);
+        break;
+      case MEMCPY:
+        memcpy (d, s, size);
+        break;
+      case MEMMOVE:
+        memmove (d + 1, d, size - 1);
+        break;
+      case MEMSET:
+        memset (d, 'x', size - 1);
+        break;
+      case MEMCMP:
+        sink += memcmp (d, s, size);
+        break;
+      case MEMCHR:
+        sink += memchr (s, '\0', size) != NULL;
+        break;
+      case STRLEN:
+        sink += strlen ((const char *) s);
+        break;
+      default:
+        NOT_REACHED ();
+      }
+  return rdtsc () - start;
+}
+
+/* Prints BYTES / CYCLES with two decimals. */
+static void
+report (enum op op, size_t size, size_t misalign, uint64_t cycles)
+{
+  uint64_t rate = (uint64_t) (ROUND_BYTES / size * size) * 100
+                  / (cycles ? cycles : 1);
+
+  msg ("%-9s %6zu bytes, offset %zu: %llu.%02llu bytes/cycle",
+       op_names[op], size, misalign, rate / 100, rate % 100);
+}
+
+void
+test_string_bench (void)
+{
+  static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536 };
+  size_t i, misalign;
+  enum op op;
+
+  src = palloc_get_multiple (PAL_ASSERT, BUF_PAGES);
+  dst = palloc_get_multiple (PAL_ASSERT, BUF_PAGES);
+
+  for (op = 0; op < OP_CNT; op++)
+    for (misalign = 0; misalign < 8; misalign += 3)
+      for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+        report (op, sizes[i], misalign, run (op, sizes[i], misalign));
+
+  palloc_free_multiple (src, BUF_PAGES);
+  palloc_free_multiple (dst, BUF_PAGES);
+  pass ();
+}
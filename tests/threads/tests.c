@@ -38,6 +38,9 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"string-bench", test_string_bench},
+    {"bitmap-bench", test_bitmap_bench},
+    {"ordered-bench", test_ordered_bench},
   };
 
 static const char *test_name;
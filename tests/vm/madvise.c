@@ -0,0 +1,81 @@
+/* Locks some pages of the BSS with mlock and drops all of them with
+   madvise(MADV_DONTNEED), checking that the locked pages keep their
+   contents and the others read back as zeros.  Then maps a file,
+   advises that it will be read sequentially and needed soon, and
+   checks that it reads back intact.  Also checks that bad arguments
+   are refused. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_COUNT 4
+#define LOCKED 2
+#define ACTUAL ((void *) 0x10000000)
+
+static char buf[PAGE_COUNT * PAGE_SIZE] __attribute__ ((aligned (PAGE_SIZE)));
+
+/* Checks that page I of BUF is all C. */
+static void
+check_page (size_t i, char c)
+{
+  size_t j;
+
+  for (j = 0; j < PAGE_SIZE; j++)
+    if (buf[i * PAGE_SIZE + j] != c)
+      fail ("byte %zu of page %zu is %d, not %d",
+            j, i, buf[i * PAGE_SIZE + j], c);
+}
+
+void
+test_main (void)
+{
+  int handle;
+  size_t i;
+
+  memset (buf, 'a', sizeof buf);
+  CHECK (mlock (buf, LOCKED * PAGE_SIZE) == 0, "mlock first pages");
+  CHECK (madvise (buf, sizeof buf, MADV_DONTNEED) == 0,
+         "madvise MADV_DONTNEED");
+  for (i = 0; i < PAGE_COUNT; i++)
+    check_page (i, i < LOCKED ? 'a' : 0);
+  msg ("locked pages kept, others dropped");
+
+  CHECK (munlock (buf, LOCKED * PAGE_SIZE) == 0, "munlock first pages");
+  CHECK (madvise (buf, sizeof buf, MADV_DONTNEED) == 0,
+         "madvise MADV_DONTNEED again");
+  for (i = 0; i < PAGE_COUNT; i++)
+    check_page (i, 0);
+  msg ("all pages dropped");
+
+  memset (buf, 'b', PAGE_SIZE);
+  CHECK (mlock (buf + 1, 0) == 0, "mlock of no bytes");
+  CHECK (madvise (buf, PAGE_SIZE, MADV_DONTNEED) == 0,
+         "madvise MADV_DONTNEED once more");
+  check_page (0, 0);
+  msg ("no page locked");
+
+  CHECK (create ("sample.txt", strlen (sample)), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (write (handle, sample, strlen (sample)) == (int) strlen (sample),
+         "write \"sample.txt\"");
+  CHECK (mmap (ACTUAL, 4096, 0, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  CHECK (madvise (ACTUAL, 4096, MADV_SEQUENTIAL) == 0,
+         "madvise MADV_SEQUENTIAL");
+  CHECK (madvise (ACTUAL, 4096, MADV_WILLNEED) == 0,
+         "madvise MADV_WILLNEED");
+  CHECK (!memcmp (ACTUAL, sample, strlen (sample)),
+         "compare mapped data against file");
+
+  CHECK (madvise (buf + 1, PAGE_SIZE, MADV_NORMAL) == -1,
+         "madvise of misaligned address fails");
+  CHECK (madvise ((char *) ACTUAL + 4096, 4096, MADV_WILLNEED) == -1,
+         "madvise past the mapping fails");
+  CHECK (madvise (buf, PAGE_SIZE, 42) == -1, "madvise of bad advice fails");
+  CHECK (mlock ((char *) ACTUAL + 4096, 4096) == -1,
+         "mlock past the mapping fails");
+}
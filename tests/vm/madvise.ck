@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) mlock first pages
+(madvise) madvise MADV_DONTNEED
+(madvise) locked pages kept, others dropped
+(madvise) munlock first pages
+(madvise) madvise MADV_DONTNEED again
+(madvise) all pages dropped
+(madvise) mlock of no bytes
+(madvise) madvise MADV_DONTNEED once more
+(madvise) no page locked
+(madvise) create "sample.txt"
+(madvise) open "sample.txt"
+(madvise) write "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) madvise MADV_SEQUENTIAL
+(madvise) madvise MADV_WILLNEED
+(madvise) compare mapped data against file
+(madvise) madvise of misaligned address fails
+(madvise) madvise past the mapping fails
+(madvise) madvise of bad advice fails
+(madvise) mlock past the mapping fails
+(madvise) end
+EOF
+pass;
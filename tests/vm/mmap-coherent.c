@@ -0,0 +1,42 @@
+/* Maps a file and checks that the mapping and the read and write
+   system calls see each other's changes at once, without msync or
+   munmap, since both go through the same page cache. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+void
+test_main (void)
+{
+  size_t len = strlen (sample);
+  char buf[1024];
+  int handle;
+  size_t i;
+
+  CHECK (create ("sample.txt", len), "create \"sample.txt\"");
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (ACTUAL, 4096, 1, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+
+  /* write() shows through the mapping. */
+  CHECK (write (handle, sample, len) == (int) len, "write \"sample.txt\"");
+  CHECK (!memcmp (ACTUAL, sample, len),
+         "compare mapped data against written data");
+
+  /* Stores to the mapping show through read(). */
+  memset (ACTUAL, 'x', len);
+  seek (handle, 0);
+  CHECK (read (handle, buf, len) == (int) len, "read \"sample.txt\"");
+  for (i = 0; i < len; i++)
+    if (buf[i] != 'x')
+      fail ("byte %zu read back as %d, not 'x'", i, buf[i]);
+  msg ("compare read data against stores to the mapping");
+
+  munmap (ACTUAL);
+  close (handle);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-coherent) begin
+(mmap-coherent) create "sample.txt"
+(mmap-coherent) open "sample.txt"
+(mmap-coherent) mmap "sample.txt"
+(mmap-coherent) write "sample.txt"
+(mmap-coherent) compare mapped data against written data
+(mmap-coherent) read "sample.txt"
+(mmap-coherent) compare read data against stores to the mapping
+(mmap-coherent) end
+EOF
+pass;
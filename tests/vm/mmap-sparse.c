@@ -0,0 +1,45 @@
+/* Maps a small file with a length of 256 MB, far more than the
+   machine has memory for, and touches only a few pages of it.
+   Only the touched pages may cost memory.  Writes past the end of
+   the file must not grow it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define LENGTH (256 * 1024 * 1024)
+
+void
+test_main (void)
+{
+  size_t offsets[] = { 4096, LENGTH / 2, LENGTH - 1 };
+  int handle;
+  void *map;
+  size_t i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (ACTUAL, LENGTH, 1, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\" with length %d", LENGTH);
+
+  if (memcmp (ACTUAL, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+
+  /* The rest of the mapping reads as zeros and can be written. */
+  for (i = 0; i < sizeof offsets / sizeof *offsets; i++)
+    {
+      char *p = ACTUAL + offsets[i];
+      if (*p != 0)
+        fail ("byte %zu of mmap'd region has value %02hhx (should be 0)",
+              offsets[i], *p);
+      *p = 'x';
+    }
+  msg ("touched pages past the end of the file");
+
+  munmap (map);
+  CHECK (filesize (handle) == (int) strlen (sample),
+         "file size unchanged after munmap");
+  close (handle);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-sparse) begin
+(mmap-sparse) open "sample.txt"
+(mmap-sparse) mmap "sample.txt" with length 268435456
+(mmap-sparse) touched pages past the end of the file
+(mmap-sparse) file size unchanged after munmap
+(mmap-sparse) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Reads untouched pages of the BSS, which should all be backed by
+   one shared page of zeros, then writes one of them, which should
+   get a page of its own without disturbing the others. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_COUNT 8
+
+static char buf[PAGE_COUNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  void *zero;
+  size_t i;
+
+  for (i = 0; i < PAGE_COUNT; i++)
+    if (buf[i * PAGE_SIZE] != 0)
+      fail ("page %zu of the BSS is not zero", i);
+  zero = get_phys_addr (&buf[0]);
+  CHECK (zero != 0, "read untouched pages");
+  for (i = 1; i < PAGE_COUNT; i++)
+    if (get_phys_addr (&buf[i * PAGE_SIZE]) != zero)
+      fail ("page %zu does not share the zero page", i);
+  msg ("untouched pages share one frame");
+
+  memset (&buf[PAGE_SIZE], 'x', PAGE_SIZE);
+  CHECK (get_phys_addr (&buf[PAGE_SIZE]) != zero,
+         "written page has a frame of its own");
+  for (i = 0; i < PAGE_COUNT; i++)
+    {
+      char want = i == 1 ? 'x' : 0;
+      if (buf[i * PAGE_SIZE] != want
+          || buf[i * PAGE_SIZE + PAGE_SIZE - 1] != want)
+        fail ("page %zu has the wrong contents after the write", i);
+    }
+  msg ("other pages still read as zeros");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(zero-page) begin
+(zero-page) read untouched pages
+(zero-page) untouched pages share one frame
+(zero-page) written page has a frame of its own
+(zero-page) other pages still read as zeros
+(zero-page) end
+EOF
+pass;
@@ -31,6 +31,10 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/evict.h"
+#include "vm/ksm.h"
+#include "vm/kswapd.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
@@ -165,6 +169,7 @@ paging_init (uint64_t mem_end) {
 
 	// reload cr3
 	pml4_activate(0);
+	pml4_init_pcid ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -226,6 +231,38 @@ parse_options (char **argv) {
 			user_page_limit = atoi (value);
 		else if (!strcmp (name, "-threads-tests"))
 			thread_tests = true;
+#endif
+#ifdef VM
+		else if (!strcmp (name, "-evict")) {
+			evict_policy = evict_policy_find (value);
+			if (evict_policy == NULL)
+				PANIC ("unknown eviction policy `%s'", value);
+		}
+		else if (!strcmp (name, "-zswap"))
+			zswap_max_pages = atoi (value);
+		else if (!strcmp (name, "-ksm"))
+			ksm_rate = atoi (value);
+		else if (!strcmp (name, "-kswapd-low")
+				|| !strcmp (name, "-kswapd-high")) {
+			int pages = atoi (value);
+
+			if (pages < 0)
+				PANIC ("option `%s' takes a page count (use -h for help)",
+						name);
+			if (!strcmp (name, "-kswapd-high"))
+				kswapd_high = pages;
+			else if ((size_t) pages >= user_page_limit)
+				PANIC ("option `%s' must be below the user pool "
+						"(use -h for help)", name);
+			else
+				kswapd_low = pages;
+		}
+		else if (!strcmp (name, "-fault-around"))
+			fault_around_pages = atoi (value);
+		else if (!strcmp (name, "-readahead"))
+			readahead_max = atoi (value);
+		else if (!strcmp (name, "-flush"))
+			flush_age = atoi (value);
 #endif
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
@@ -328,6 +365,24 @@ usage (void) {
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+			"  -evict=POLICY      Evict pages by POLICY: clock (default),\n"
+			"                     wsclock, 2q, or cost.\n"
+			"  -zswap=PAGES       Keep up to PAGES pages of compressed swap\n"
+			"                     in memory.\n"
+			"  -ksm=RATE          Merge identical anonymous pages, looking\n"
+			"                     at RATE pages per second.\n"
+			"  -kswapd-low=PAGES  Evict pages in the background when fewer\n"
+			"                     than PAGES user pages are free (default: off).\n"
+			"  -kswapd-high=PAGES ...until PAGES are free (default: twice\n"
+			"                     the low mark).\n"
+			"  -fault-around=N    Read file pages in aligned windows of N\n"
+			"                     pages on a fault (default: off).\n"
+			"  -readahead=N       Read up to N file pages ahead of sequential\n"
+			"                     faults, in the background (default: off).\n"
+			"  -flush=SECS        Write back file pages dirty for SECS\n"
+			"                     seconds (default: 30, 0: never).\n"
 #endif
 			);
 	power_off ();
@@ -354,6 +409,7 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	palloc_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
 #endif
@@ -361,5 +417,9 @@ print_stats (void) {
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
+	pml4_print_stats ();
+#endif
+#ifdef VM
+	vm_print_stats ();
 #endif
 }
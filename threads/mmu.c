@@ -1,13 +1,40 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdio.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Process-context identifiers.  With CR4.PCIDE set, the low 12 bits
+ * of CR3 tag every TLB entry with the address space that created
+ * it, so switching page tables no longer has to throw the TLB away.
+ * PCID 0 belongs to base_pml4; the others are handed out round-robin
+ * to the page tables that are activated. */
+#define PCID_CNT 64                     /* PCIDs in use, including 0. */
+#define CR3_NOFLUSH (1ULL << 63)        /* Keep TLB entries of the PCID. */
+#define CR4_PCIDE (1ULL << 17)          /* Enable PCIDs. */
+#define CPUID_1_ECX_PCID (1U << 17)     /* CPU supports PCIDs. */
+
+static bool pcid_enabled;               /* CR4.PCIDE is set. */
+static uint64_t *pcid_owner[PCID_CNT];  /* Page table tagged by each PCID. */
+static bool pcid_stale[PCID_CNT];       /* Flush on next activation? */
+static unsigned pcid_next = 1;          /* Next PCID to recycle. */
+
+/* Statistics. */
+static long long cr3_loads;     /* # of writes to CR3. */
+static long long cr3_skips;     /* # of activations that kept CR3. */
+static long long pcid_hits;     /* # of CR3 writes that kept the TLB. */
+static long long tlb_page_flushes;  /* # of batched invlpgs. */
+static long long tlb_full_flushes;  /* # of batches flushed at once. */
+
+static void pcid_retire (uint64_t *pml4);
+static void pcid_mark_stale (uint64_t *pml4);
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
@@ -23,6 +50,8 @@ pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 			} else
 				return NULL;
 		}
+		if (pdp[idx] & PTE_PS)
+			return NULL;
 		return (uint64_t *) ptov (PTE_ADDR (pdp[idx]) + 8 * PTX (va));
 	}
 	return NULL;
@@ -88,6 +117,50 @@ pml4e_walk (uint64_t *pml4e, const uint64_t va, int create) {
 	return pte;
 }
 
+/* Returns the address of the page directory entry for virtual
+ * address VA in PML4.  If a page-directory-pointer table or page
+ * directory on the way is missing, behavior depends on CREATE.  If
+ * CREATE is true, then the missing tables are created.  Otherwise,
+ * a null pointer is returned. */
+static uint64_t *
+pde_walk (uint64_t *pml4, const uint64_t va, int create) {
+	const int idx[] = { PML4 (va), PDPE (va) };
+	uint64_t *table = pml4;
+
+	for (unsigned i = 0; i < sizeof idx / sizeof *idx; i++) {
+		uint64_t *entry = &table[idx[i]];
+		if (!(*entry & PTE_P)) {
+			uint64_t *new_page;
+			if (!create || (new_page = palloc_get_page (PAL_ZERO)) == NULL)
+				return NULL;
+			*entry = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+		}
+		table = ptov (PTE_ADDR (*entry));
+	}
+	return &table[PDX (va)];
+}
+
+/* Returns the page directory entry that maps VA with a 2 MB page
+ * in PML4, or a null pointer if VA is not covered by a huge
+ * mapping. */
+static uint64_t *
+huge_pde_lookup (uint64_t *pml4, const uint64_t va) {
+	uint64_t *pde = pde_walk (pml4, va, false);
+	if (pde != NULL && (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS))
+		return pde;
+	return NULL;
+}
+
+/* Returns the entry that finally maps VA in PML4: the page table
+ * entry for a 4 kB mapping, or the page directory entry for a 2 MB
+ * mapping.  The A, D, W, U, and P bits sit at the same position in
+ * both, so the accessors below can treat them alike. */
+static uint64_t *
+leaf_walk (uint64_t *pml4, const uint64_t va) {
+	uint64_t *pte = pml4e_walk (pml4, va, false);
+	return pte != NULL ? pte : huge_pde_lookup (pml4, va);
+}
+
 /* Creates a new page map level 4 (pml4) has mappings for kernel
  * virtual addresses, but none for user virtual addresses.
  * Returns the new page directory, or a null pointer if memory
@@ -122,10 +195,17 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
-			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
-					pml4_index, pdp_index, i))
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		if (((uint64_t) pte) & PTE_PS) {
+			void *va = (void *) (((uint64_t) pml4_index << PML4SHIFT) |
+								 ((uint64_t) pdp_index << PDPESHIFT) |
+								 ((uint64_t) i << PDXSHIFT));
+			if (!func (&pdp[i], va, aux))
 				return false;
+		} else if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
+					pml4_index, pdp_index, i))
+			return false;
 	}
 	return true;
 }
@@ -143,7 +223,9 @@ pdp_for_each (uint64_t *pdp,
 	return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each available pte entries including kernel's.
+ * A 2 MB mapping is visited once, with its page directory entry
+ * and the address of its first page. */
 bool
 pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
@@ -169,7 +251,11 @@ static void
 pgdir_destroy (uint64_t *pdp) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if (!(((uint64_t) pte) & PTE_P))
+			continue;
+		if (((uint64_t) pte) & PTE_PS)
+			palloc_free_huge_page (hpg_round_down (pte));
+		else
 			pt_destroy (PTE_ADDR (pte));
 	}
 	palloc_free_page ((void *) pdp);
@@ -196,14 +282,173 @@ pml4_destroy (uint64_t *pml4) {
 	uint64_t *pdpe = ptov ((uint64_t *) pml4[0]);
 	if (((uint64_t) pdpe) & PTE_P)
 		pdpe_destroy ((void *) PTE_ADDR (pdpe));
+	pcid_retire (pml4);
 	palloc_free_page ((void *) pml4);
 }
 
+/* Turns on PCIDs if the CPU supports them.  Must be called while
+ * base_pml4 is active. */
+void
+pml4_init_pcid (void) {
+	uint32_t eax, ebx, ecx, edx;
+
+	ASSERT (PTE_ADDR (rcr3 ()) == vtop (base_pml4));
+
+	cpuid (1, 0, &eax, &ebx, &ecx, &edx);
+	if (ecx & CPUID_1_ECX_PCID) {
+		lcr4 (rcr4 () | CR4_PCIDE);
+		pcid_owner[0] = base_pml4;
+		pcid_enabled = true;
+	}
+}
+
+/* Returns the CR3 value that activates PML4.  If PML4 still owns a
+ * PCID, its TLB entries are kept, unless they were marked stale;
+ * otherwise the least recently handed out PCID is taken from its
+ * owner.  Either way, entries that are not kept are flushed on the
+ * CR3 write. */
+static uint64_t
+pcid_assign (uint64_t *pml4) {
+	unsigned pcid;
+
+	if (!pcid_enabled)
+		return vtop (pml4);
+
+	for (pcid = 0; pcid < PCID_CNT; pcid++)
+		if (pcid_owner[pcid] == pml4) {
+			if (pcid_stale[pcid]) {
+				pcid_stale[pcid] = false;
+				return vtop (pml4) | pcid;
+			}
+			pcid_hits++;
+			return vtop (pml4) | pcid | CR3_NOFLUSH;
+		}
+
+	pcid = pcid_next;
+	pcid_next = pcid_next + 1 < PCID_CNT ? pcid_next + 1 : 1;
+	pcid_owner[pcid] = pml4;
+	pcid_stale[pcid] = false;
+	return vtop (pml4) | pcid;
+}
+
+/* Takes away the PCID of PML4, if it has one, so that the TLB
+ * entries tagged with it are flushed before they can be used
+ * again.  This is how changes to the mappings of a page table that
+ * is not active are made visible, and it keeps a freed page table
+ * from passing its entries on to a new one at the same address. */
+static void
+pcid_retire (uint64_t *pml4) {
+	for (unsigned pcid = 1; pcid < PCID_CNT; pcid++)
+		if (pcid_owner[pcid] == pml4)
+			pcid_owner[pcid] = NULL;
+}
+
+/* Makes the next activation of PML4 flush the TLB entries tagged
+ * with its PCID, if it has one, but lets it keep the PCID, so that
+ * no other page table loses its entries to make room for it. */
+static void
+pcid_mark_stale (uint64_t *pml4) {
+	for (unsigned pcid = 1; pcid < PCID_CNT; pcid++)
+		if (pcid_owner[pcid] == pml4)
+			pcid_stale[pcid] = true;
+}
+
+/* Returns true if PML4 is the page table the CPU is using. */
+static bool
+pml4_is_active (uint64_t *pml4) {
+	return PTE_ADDR (rcr3 ()) == vtop (pml4);
+}
+
+/* Invalidates the TLB entry for VA in PML4 after its page table
+ * entry has been changed. */
+static void
+tlb_invalidate (uint64_t *pml4, const void *va) {
+	if (pml4_is_active (pml4))
+		invlpg ((uint64_t) va);
+	else if (pcid_enabled)
+		pcid_retire (pml4);
+}
+
+/* Invalidates every TLB entry and cached paging structure of PML4,
+ * for changes that a single invlpg does not cover. */
+static void
+tlb_invalidate_all (uint64_t *pml4) {
+	if (pml4_is_active (pml4))
+		lcr3 (rcr3 ());
+	else if (pcid_enabled)
+		pcid_retire (pml4);
+}
+
+/* Starts collecting TLB invalidations for PML4 in BATCH.  Used
+ * when many entries are changed at once, for example when a large
+ * range is unmapped. */
+void
+tlb_batch_init (struct tlb_batch *batch, uint64_t *pml4) {
+	batch->pml4 = pml4;
+	batch->cnt = 0;
+}
+
+/* Records in BATCH that the entry for VA has been changed.  The
+ * stale TLB entry may still be used until tlb_batch_finish() is
+ * called. */
+void
+tlb_batch_add (struct tlb_batch *batch, const void *va) {
+	if (batch->cnt < TLB_BATCH_LEN)
+		batch->va[batch->cnt] = va;
+	batch->cnt++;
+}
+
+/* Invalidates the TLB entries recorded in BATCH: one by one if
+ * there are only a few of them, otherwise with a single flush of
+ * the whole page table, which is cheaper than many invlpgs and
+ * the refills that follow either way. */
+void
+tlb_batch_finish (struct tlb_batch *batch) {
+	if (batch->cnt == 0)
+		return;
+
+	if (!pml4_is_active (batch->pml4)) {
+		if (pcid_enabled)
+			pcid_retire (batch->pml4);
+	} else if (batch->cnt > TLB_BATCH_LEN) {
+		tlb_invalidate_all (batch->pml4);
+		tlb_full_flushes++;
+	} else {
+		for (size_t i = 0; i < batch->cnt; i++)
+			invlpg ((uint64_t) batch->va[i]);
+		tlb_page_flushes += batch->cnt;
+	}
+	batch->cnt = 0;
+}
+
 /* Loads page directory PD into the CPU's page directory base
- * register. */
+ * register.  Nothing is done if PD is already loaded, since the
+ * write would only flush the TLB. */
 void
 pml4_activate (uint64_t *pml4) {
-	lcr3 (vtop (pml4 ? pml4 : base_pml4));
+	enum intr_level old_level;
+
+	if (pml4 == NULL)
+		pml4 = base_pml4;
+
+	old_level = intr_disable ();
+	if (pml4_is_active (pml4))
+		cr3_skips++;
+	else {
+		lcr3 (pcid_assign (pml4));
+		cr3_loads++;
+	}
+	intr_set_level (old_level);
+}
+
+/* Prints page table switching statistics. */
+void
+pml4_print_stats (void) {
+	printf ("TLB: %lld CR3 loads, %lld skipped, %lld PCID hits%s\n",
+			cr3_loads, cr3_skips, pcid_hits,
+			pcid_enabled ? "" : " (PCID unsupported)");
+	printf ("TLB: %lld batched page invalidations, %lld full flushes\n",
+			tlb_page_flushes, tlb_full_flushes);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -218,12 +463,16 @@ pml4_get_page (uint64_t *pml4, const void *uaddr) {
 
 	if (pte && (*pte & PTE_P))
 		return ptov (PTE_ADDR (*pte)) + pg_ofs (uaddr);
+
+	pte = huge_pde_lookup (pml4, (uint64_t) uaddr);
+	if (pte)
+		return ptov (*pte & ~HPGMASK) + hpg_ofs (uaddr);
 	return NULL;
 }
 
 /* Adds a mapping in page map level 4 PML4 from user virtual page
  * UPAGE to the physical frame identified by kernel virtual address KPAGE.
- * UPAGE must not already be mapped. KPAGE should probably be a page obtained
+ * If UPAGE is already mapped, the old mapping is replaced. KPAGE should probably be a page obtained
  * from the user pool with palloc_get_page().
  * If WRITABLE is true, the new page is read/write;
  * otherwise it is read-only.
@@ -238,37 +487,159 @@ pml4_set_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
 	uint64_t *pte = pml4e_walk (pml4, (uint64_t) upage, 1);
 
-	if (pte)
+	if (pte) {
+		bool was_present = (*pte & PTE_P) != 0;
 		*pte = vtop (kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
+		if (was_present)
+			tlb_invalidate (pml4, upage);
+	}
 	return pte != NULL;
 }
 
+/* Returns true if every entry of page table PT is "not
+ * present". */
+static bool
+pt_is_empty (const uint64_t *pt) {
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		if (pt[i] & PTE_P)
+			return false;
+	return true;
+}
+
+/* Adds a 2 MB mapping in PML4 from user virtual address UPAGE to
+ * the physically contiguous frame at kernel virtual address KPAGE,
+ * as obtained from palloc_get_huge_page().  Both must be 2 MB
+ * aligned.  If WRITABLE is true, the new page is read/write;
+ * otherwise it is read-only.
+ * Returns true if successful, false if some page in the range is
+ * already mapped or if memory allocation failed.  A leftover page
+ * table with no present entries is released and replaced. */
+bool
+pml4_set_huge_page (uint64_t *pml4, void *upage, void *kpage, bool rw) {
+	ASSERT (hpg_ofs (upage) == 0);
+	ASSERT (hpg_ofs (kpage) == 0);
+	ASSERT (is_user_vaddr (upage));
+	ASSERT (pml4 != base_pml4);
+
+	uint64_t *pde = pde_walk (pml4, (uint64_t) upage, 1);
+	if (pde == NULL)
+		return false;
+
+	if (*pde & PTE_P) {
+		uint64_t *pt = ptov (PTE_ADDR (*pde));
+		if ((*pde & PTE_PS) || !pt_is_empty (pt))
+			return false;
+		*pde = 0;
+		tlb_invalidate_all (pml4);
+		palloc_free_page (pt);
+	}
+
+	*pde = vtop (kpage) | PTE_P | PTE_PS | (rw ? PTE_W : 0) | PTE_U;
+	return true;
+}
+
+/* Returns true if UPAGE is covered by a 2 MB mapping in PML4. */
+bool
+pml4_is_huge (uint64_t *pml4, const void *upage) {
+	return huge_pde_lookup (pml4, (uint64_t) upage) != NULL;
+}
+
+/* Replaces the 2 MB mapping that covers UPAGE in PML4 by a page
+ * table of 512 4 kB mappings onto the same frame, carrying over
+ * the permission, accessed, and dirty bits.  Afterwards each 4 kB
+ * page can be unmapped, protected, or evicted on its own.
+ * Returns true if successful or if UPAGE was not covered by a huge
+ * mapping, false if memory allocation failed. */
+bool
+pml4_split_huge_page (uint64_t *pml4, const void *upage) {
+	uint64_t *pde = huge_pde_lookup (pml4, (uint64_t) upage);
+	uint64_t *pt, pa, flags;
+
+	if (pde == NULL)
+		return true;
+
+	pt = palloc_get_page (0);
+	if (pt == NULL)
+		return false;
+
+	pa = *pde & ~HPGMASK;
+	flags = *pde & PTE_FLAGS & ~PTE_PS;
+	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+		pt[i] = (pa + (uint64_t) i * PGSIZE) | flags;
+
+	*pde = vtop (pt) | PTE_U | PTE_W | PTE_P;
+
+	/* The TLB may hold the 2 MB translation and the paging-structure
+	 * caches may hold the old PDE, so a single invlpg is not enough. */
+	tlb_invalidate_all (pml4);
+	return true;
+}
+
+/* Marks the 2 MB mapping that covers UPAGE in PML4 "not present".
+ * The frame is not freed.  Does nothing if UPAGE is not covered by
+ * a huge mapping. */
+void
+pml4_clear_huge_page (uint64_t *pml4, void *upage) {
+	uint64_t *pde = huge_pde_lookup (pml4, (uint64_t) upage);
+
+	if (pde != NULL) {
+		*pde &= ~PTE_P;
+		tlb_invalidate (pml4, hpg_round_down (upage));
+	}
+}
+
 /* Marks user virtual page UPAGE "not present" in page
  * directory PD.  Later accesses to the page will fault.  Other
  * bits in the page table entry are preserved.
- * UPAGE need not be mapped. */
+ * UPAGE need not be mapped, but must not be covered by a 2 MB
+ * mapping; split that with pml4_split_huge_page() first. */
 void
 pml4_clear_page (uint64_t *pml4, void *upage) {
 	uint64_t *pte;
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (is_user_vaddr (upage));
+	ASSERT (huge_pde_lookup (pml4, (uint64_t) upage) == NULL);
 
 	pte = pml4e_walk (pml4, (uint64_t) upage, false);
 
 	if (pte != NULL && (*pte & PTE_P) != 0) {
 		*pte &= ~PTE_P;
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) upage);
+		tlb_invalidate (pml4, upage);
 	}
 }
 
+/* Marks the PAGE_CNT user virtual pages starting at UPAGE "not
+ * present" in PML4, as pml4_clear_page() does, but invalidates the
+ * TLB once for the whole range. */
+void
+pml4_clear_range (uint64_t *pml4, void *upage, size_t page_cnt) {
+	struct tlb_batch batch;
+
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (is_user_vaddr (upage));
+
+	tlb_batch_init (&batch, pml4);
+	for (size_t i = 0; i < page_cnt; i++) {
+		void *va = (uint8_t *) upage + i * PGSIZE;
+		uint64_t *pte;
+
+		ASSERT (huge_pde_lookup (pml4, (uint64_t) va) == NULL);
+		pte = pml4e_walk (pml4, (uint64_t) va, false);
+		if (pte != NULL && (*pte & PTE_P) != 0) {
+			*pte &= ~PTE_P;
+			tlb_batch_add (&batch, va);
+		}
+	}
+	tlb_batch_finish (&batch);
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
  * installed.
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_dirty (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = leaf_walk (pml4, (uint64_t) vpage);
 	return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -276,15 +647,14 @@ pml4_is_dirty (uint64_t *pml4, const void *vpage) {
  * in PML4. */
 void
 pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = leaf_walk (pml4, (uint64_t) vpage);
 	if (pte) {
 		if (dirty)
 			*pte |= PTE_D;
 		else
-			*pte &= ~(uint32_t) PTE_D;
+			*pte &= ~(uint64_t) PTE_D;
 
-		if (rcr3 () == vtop (pml4))
-			invlpg ((uint64_t) vpage);
+		tlb_invalidate (pml4, vpage);
 	}
 }
 
@@ -294,22 +664,45 @@ pml4_set_dirty (uint64_t *pml4, const void *vpage, bool dirty) {
  * PML4 contains no PTE for VPAGE. */
 bool
 pml4_is_accessed (uint64_t *pml4, const void *vpage) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = leaf_walk (pml4, (uint64_t) vpage);
 	return pte != NULL && (*pte & PTE_A) != 0;
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  The CPU sets the bit only when it walks the page
+   table, so a TLB entry left for VPAGE would keep the page looking
+   unused for as long as the entry lasts.  An inactive PML4 is
+   flushed on its next activation instead of losing its PCID, which
+   the replacement policies' sweeps would otherwise take from nearly
+   every process. */
 void
 pml4_set_accessed (uint64_t *pml4, const void *vpage, bool accessed) {
-	uint64_t *pte = pml4e_walk (pml4, (uint64_t) vpage, false);
+	uint64_t *pte = leaf_walk (pml4, (uint64_t) vpage);
 	if (pte) {
 		if (accessed)
 			*pte |= PTE_A;
 		else
-			*pte &= ~(uint32_t) PTE_A;
+			*pte &= ~(uint64_t) PTE_A;
 
-		if (rcr3 () == vtop (pml4))
+		if (pml4_is_active (pml4))
 			invlpg ((uint64_t) vpage);
+		else if (pcid_enabled)
+			pcid_mark_stale (pml4);
+	}
+}
+
+/* Makes the PTE for virtual page VPAGE in PML4 read/write if
+   WRITABLE is true and read-only otherwise, leaving the rest of it,
+   including the accessed and dirty bits, as it is. */
+void
+pml4_set_writable (uint64_t *pml4, const void *vpage, bool writable) {
+	uint64_t *pte = leaf_walk (pml4, (uint64_t) vpage);
+	if (pte) {
+		if (writable)
+			*pte |= PTE_W;
+		else
+			*pte &= ~(uint64_t) PTE_W;
+
+		tlb_invalidate (pml4, vpage);
 	}
 }
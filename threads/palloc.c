@@ -2,12 +2,14 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,15 +26,40 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   While there is nothing else to run, the idle thread takes free
+   pages out of each pool, zeroes them, and keeps them on the
+   pool's list of pre-zeroed pages, so that single-page PAL_ZERO
+   requests do not have to clear memory on the caller's path.
+   Those pages are marked used in the bitmap; each one holds the
+   list_elem that links it at its start.  The list is protected by
+   disabling interrupts rather than by the pool lock, because the
+   idle thread must never block. */
 
 /* A memory pool. */
 struct pool {
 	struct lock lock;               /* Mutual exclusion. */
 	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+
+	struct list zeroed;             /* Pre-zeroed pages. */
+	size_t zeroed_cnt;              /* Number of pages in ZEROED. */
+	size_t zeroed_low;              /* Start refilling below this. */
+	size_t zeroed_high;             /* Stop refilling at this. */
+	bool refilling;                 /* Idle thread is refilling. */
 };
 
+/* Pre-zeroed list watermarks, as a fraction of the pool size and
+   as an upper limit in pages. */
+#define ZEROED_HIGH_DIV 32
+#define ZEROED_HIGH_MAX 128
+
+/* Statistics. */
+static long long zeroed_hits;   /* # of PAL_ZERO pages from the list. */
+static long long zeroed_misses; /* # of PAL_ZERO pages zeroed on demand. */
+static long long zeroed_idle;   /* # of pages zeroed by the idle thread. */
+
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
@@ -42,6 +69,9 @@ static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void *zeroed_pop (struct pool *);
+static void zeroed_push (struct pool *, void *page);
+static bool zeroed_drain (struct pool *);
 
 /* multiboot info */
 struct multiboot_info {
@@ -262,16 +292,35 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	void *pages = NULL;
 
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
-	void *pages;
+	if (page_cnt == 1 && (flags & PAL_ZERO)) {
+		pages = zeroed_pop (pool);
+		if (pages != NULL) {
+			zeroed_hits++;
+			return pages;
+		}
+		zeroed_misses++;
+	}
 
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
-		pages = NULL;
+	for (;;) {
+		lock_acquire (&pool->lock);
+		size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt,
+				false);
+		lock_release (&pool->lock);
+
+		if (page_idx != BITMAP_ERROR) {
+			pages = pool->base + PGSIZE * page_idx;
+			break;
+		}
+
+		/* Out of free pages: fall back on the pre-zeroed ones, which
+		   are free as well. */
+		if (page_cnt == 1 && (pages = zeroed_pop (pool)) != NULL)
+			return pages;
+		if (!zeroed_drain (pool))
+			break;
+	}
 
 	if (pages) {
 		if (flags & PAL_ZERO)
@@ -296,6 +345,42 @@ palloc_get_page (enum palloc_flags flags) {
 	return palloc_get_multiple (flags, 1);
 }
 
+/* Obtains a run of HPGSIZE / PGSIZE free pages whose physical
+   address is aligned to a 2 MB boundary, suitable for mapping
+   with a single page directory entry, and returns its kernel
+   virtual address.  FLAGS are interpreted as for
+   palloc_get_multiple().  Returns a null pointer if no aligned
+   run is free, unless PAL_ASSERT is set. */
+void *
+palloc_get_huge_page (enum palloc_flags flags) {
+	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+	const size_t page_cnt = HPGSIZE / PGSIZE;
+	size_t pool_cnt = bitmap_size (pool->used_map);
+	size_t page_idx = pg_no (hpg_round_up (pool->base)) - pg_no (pool->base);
+	void *pages = NULL;
+
+	do {
+		lock_acquire (&pool->lock);
+		for (size_t i = page_idx; i + page_cnt <= pool_cnt; i += page_cnt)
+			if (bitmap_none (pool->used_map, i, page_cnt)) {
+				bitmap_set_multiple (pool->used_map, i, page_cnt, true);
+				pages = pool->base + PGSIZE * i;
+				break;
+			}
+		lock_release (&pool->lock);
+	} while (pages == NULL && zeroed_drain (pool));
+
+	if (pages) {
+		if (flags & PAL_ZERO)
+			memset (pages, 0, HPGSIZE);
+	} else {
+		if (flags & PAL_ASSERT)
+			PANIC ("palloc_get_huge_page: out of pages");
+	}
+
+	return pages;
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
@@ -328,6 +413,118 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* Frees the 2 MB run at PAGE obtained from palloc_get_huge_page().
+   The run may also be freed one page at a time, e.g. after its
+   mapping was split. */
+void
+palloc_free_huge_page (void *page) {
+	ASSERT (hpg_ofs (page) == 0);
+	palloc_free_multiple (page, HPGSIZE / PGSIZE);
+}
+
+/* Zeroes one free page in the background, if a pool is short of
+   pre-zeroed pages.  Called by the idle thread with interrupts
+   enabled; never blocks.  Returns true if a page was zeroed, false
+   if there was nothing to do. */
+bool
+palloc_prezero (void) {
+	struct pool *pools[] = { &kernel_pool, &user_pool };
+
+	for (size_t i = 0; i < sizeof pools / sizeof *pools; i++) {
+		struct pool *pool = pools[i];
+		size_t page_idx;
+		void *page;
+
+		if (pool->zeroed_cnt < pool->zeroed_low)
+			pool->refilling = true;
+		else if (pool->zeroed_cnt >= pool->zeroed_high)
+			pool->refilling = false;
+		if (!pool->refilling || !lock_try_acquire (&pool->lock))
+			continue;
+
+		page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+		lock_release (&pool->lock);
+		if (page_idx == BITMAP_ERROR) {
+			pool->refilling = false;
+			continue;
+		}
+
+		page = pool->base + PGSIZE * page_idx;
+		memset (page, 0, PGSIZE);
+		zeroed_push (pool, page);
+		zeroed_idle++;
+		return true;
+	}
+	return false;
+}
+
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_cnt (void) {
+	return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the number of pages free in the user pool, counting the
+   pre-zeroed ones.  Does not take the pool's lock, so the count may
+   be a little out of date by the time it is used. */
+size_t
+palloc_user_free_cnt (void) {
+	struct bitmap *map = user_pool.used_map;
+
+	return bitmap_count (map, 0, bitmap_size (map), false)
+		+ user_pool.zeroed_cnt;
+}
+
+/* Prints pre-zeroed page statistics. */
+void
+palloc_print_stats (void) {
+	printf ("Palloc: %lld pre-zeroed hits, %lld misses, "
+			"%lld zeroed while idle\n", zeroed_hits, zeroed_misses, zeroed_idle);
+}
+
+/* Removes a page from POOL's pre-zeroed list and returns it, fully
+   zeroed, or returns a null pointer if the list is empty. */
+static void *
+zeroed_pop (struct pool *pool) {
+	struct list_elem *e = NULL;
+	enum intr_level old_level = intr_disable ();
+
+	if (!list_empty (&pool->zeroed)) {
+		e = list_pop_front (&pool->zeroed);
+		pool->zeroed_cnt--;
+	}
+	intr_set_level (old_level);
+
+	if (e != NULL)
+		memset (e, 0, sizeof *e);
+	return e;
+}
+
+/* Adds zeroed PAGE, which must be marked used in POOL, to POOL's
+   pre-zeroed list. */
+static void
+zeroed_push (struct pool *pool, void *page) {
+	enum intr_level old_level = intr_disable ();
+	list_push_front (&pool->zeroed, (struct list_elem *) page);
+	pool->zeroed_cnt++;
+	intr_set_level (old_level);
+}
+
+/* Gives every page on POOL's pre-zeroed list back to the bitmap,
+   so that a request for contiguous pages can use them.  Returns
+   true if any page was given back. */
+static bool
+zeroed_drain (struct pool *pool) {
+	bool drained = false;
+	void *page;
+
+	while ((page = zeroed_pop (pool)) != NULL) {
+		palloc_free_page (page);
+		drained = true;
+	}
+	return drained;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
@@ -341,6 +538,13 @@ init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
 	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	p->base = (void *) start;
 
+	list_init (&p->zeroed);
+	p->zeroed_cnt = 0;
+	p->zeroed_high = pgcnt / ZEROED_HIGH_DIV < ZEROED_HIGH_MAX ?
+		pgcnt / ZEROED_HIGH_DIV : ZEROED_HIGH_MAX;
+	p->zeroed_low = p->zeroed_high / 2;
+	p->refilling = false;
+
 	// Mark all to unusable.
 	bitmap_set_all(p->used_map, true);
 
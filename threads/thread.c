@@ -389,6 +389,12 @@ idle(void *idle_started_ UNUSED)
 
 	for (;;)
 	{
+		/* Nothing else to run: zero free pages ahead of time, one at
+		   a time, so that a thread that becomes ready waits for at
+		   most one page. */
+		while (list_empty(&ready_list) && palloc_prezero())
+			continue;
+
 		/* Let someone else run. */
 		intr_disable();
 		thread_block();
@@ -355,8 +355,11 @@ process_cleanup(void)
  * This function is called on every context switch. */
 void process_activate(struct thread *next)
 {
-	/* Activate thread's page tables. */
-	pml4_activate(next->pml4);
+	/* Activate thread's page tables.  A kernel thread never touches
+	 * user memory, so it keeps running on the page tables of whoever
+	 * ran before it instead of paying for a switch both ways. */
+	if (next->pml4 != NULL)
+		pml4_activate(next->pml4);
 
 	/* Set thread's kernel stack for use in processing interrupts. */
 	tss_update(next);
@@ -693,14 +696,6 @@ install_page(void *upage, void *kpage, bool writable)
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment(struct page *page, void *aux)
-{
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -713,50 +708,56 @@ lazy_load_segment(struct page *page, void *aux)
  * The pages initialized by this function must be writable by the
  * user process if WRITABLE is true, read-only otherwise.
  *
+ * The segment becomes one anonymous area whose pages are read from
+ * FILE, or zeroed, when they are first touched.  Pages of a read-only
+ * segment map the page cache instead, so that every process running
+ * the program shares them.
+ *
  * Return true if successful, false if a memory allocation error
  * or disk read error occurs. */
 static bool
 load_segment(struct file *file, off_t ofs, uint8_t *upage,
 			 uint32_t read_bytes, uint32_t zero_bytes, bool writable)
 {
+	struct file *backing = NULL;
+
 	ASSERT((read_bytes + zero_bytes) % PGSIZE == 0);
 	ASSERT(pg_ofs(upage) == 0);
 	ASSERT(ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0)
+	/* The area keeps its own handle on the file. */
+	if (read_bytes > 0)
 	{
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer(VM_ANON, upage,
-											writable, lazy_load_segment, aux))
+		backing = file_reopen(file);
+		if (backing == NULL)
 			return false;
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
+	}
+	if (spt_add_area(&thread_current()->spt, upage,
+					 upage + read_bytes + zero_bytes, VM_ANON, writable,
+					 backing, ofs, read_bytes) == NULL)
+	{
+		file_close(backing);
+		return false;
 	}
 	return true;
 }
 
-/* Create a PAGE of stack at the USER_STACK. Return true on success. */
+/* Create a PAGE of stack at the USER_STACK. Return true on success.
+ * The stack's area starts out one page long and grows down as the
+ * process pushes past it. */
 static bool
 setup_stack(struct intr_frame *if_)
 {
 	bool success = false;
 	void *stack_bottom = (void *)(((uint8_t *)USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
-
+	if (spt_add_area(&thread_current()->spt, stack_bottom, (void *)USER_STACK,
+					 VM_ANON | VM_STACK, true, NULL, 0, 0) != NULL &&
+		vm_claim_page(stack_bottom))
+	{
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 	return success;
 }
 #endif /* VM */
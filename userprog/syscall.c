@@ -15,11 +15,13 @@
 #include "filesys/file.h"
 #include "devices/input.h"
 #include "threads/palloc.h"
+#include "threads/vaddr.h"
 
 void syscall_entry(void);
 void syscall_handler(struct intr_frame *);
 
 void check_address(void *addr);
+void check_buffer(const void *buffer, unsigned size, bool writable);
 
 // system call 대응 함수
 void halt(void);
@@ -36,6 +38,14 @@ int write(int fd, const void *buffer, unsigned size);
 void seek(int fd, unsigned position);
 unsigned tell(int fd);
 void close(int fd);
+#ifdef VM
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
+void munmap(void *addr);
+int msync(void *addr, size_t length);
+int madvise(void *addr, size_t length, int advice);
+int mlock(void *addr, size_t length);
+int munlock(void *addr, size_t length);
+#endif
 
 /* System call.
  *
@@ -70,6 +80,10 @@ void syscall_init(void) {
 void syscall_handler(struct intr_frame *f UNUSED) {
 	int sys_num = f->R.rax; // syscall number
 
+#ifdef VM
+	thread_current()->user_rsp = (void *)f->rsp; // 스택 확장 판단에 사용
+#endif
+
 	switch (sys_num) {
 	case SYS_HALT:
 		halt();
@@ -112,6 +126,27 @@ void syscall_handler(struct intr_frame *f UNUSED) {
 		break;
 	case SYS_CLOSE:
 		close(f->R.rdi);
+		break;
+#ifdef VM
+	case SYS_MMAP:
+		f->R.rax = (uint64_t)mmap((void *)f->R.rdi, f->R.rsi, f->R.rdx, f->R.r10, f->R.r8);
+		break;
+	case SYS_MUNMAP:
+		munmap((void *)f->R.rdi);
+		break;
+	case SYS_MSYNC:
+		f->R.rax = msync((void *)f->R.rdi, f->R.rsi);
+		break;
+	case SYS_MADVISE:
+		f->R.rax = madvise((void *)f->R.rdi, f->R.rsi, f->R.rdx);
+		break;
+	case SYS_MLOCK:
+		f->R.rax = mlock((void *)f->R.rdi, f->R.rsi);
+		break;
+	case SYS_MUNLOCK:
+		f->R.rax = munlock((void *)f->R.rdi, f->R.rsi);
+		break;
+#endif
 	}
 }
 
@@ -125,9 +160,44 @@ void check_address(void *addr) {
 	if (!is_user_vaddr(addr)) { // 유저 영역에 속해있지 않을 경우
 		exit(-1);
 	}
+#ifdef VM
+	if (!vm_access_ok(addr, false)) { // 아직 로드되지 않은 페이지도 허용
+		exit(-1);
+	}
+#else
 	if(pml4_get_page(thread_current()->pml4, addr) == NULL) {
 		exit(-1);
 	}
+#endif
+}
+
+/*
+ * 버퍼 전체가 올바른 주소인지 확인하는 함수
+ * WRITABLE이면 버퍼에 쓸 수 있는지도 확인한다.
+ */
+void check_buffer(const void *buffer, unsigned size, bool writable UNUSED) {
+	const uint8_t *addr = buffer;
+	const uint8_t *end = addr + size;
+
+	check_address(buffer);
+	if (end < addr) {
+		exit(-1);
+	}
+	// 버퍼가 걸친 페이지마다 확인
+	for (; addr < end; addr = (const uint8_t *)pg_round_down(addr) + PGSIZE) {
+		if (!is_user_vaddr(addr)) {
+			exit(-1);
+		}
+#ifdef VM
+		if (!vm_access_ok(addr, writable)) {
+			exit(-1);
+		}
+#else
+		if (pml4_get_page(thread_current()->pml4, addr) == NULL) {
+			exit(-1);
+		}
+#endif
+	}
 }
 
 // 운영체제를 중지한다.
@@ -138,6 +208,8 @@ void halt(void) {
 // 현재 프로세스를 중지한다.
 void exit(int status) {
 	struct thread *curr = thread_current();
+	// 파일 시스템 락을 쥔 채 종료하면 안 된다
+	ASSERT(!lock_held_by_current_thread(&filesys_lock));
 	curr->exit_status = status;
 	printf("%s: exit(%d)\n", curr->name, status); // 종료 메시지 출력
 	thread_exit();
@@ -209,7 +281,7 @@ int filesize(int fd) {
 
 // 파일 읽기
 int read(int fd, void *buffer, unsigned size) {
-	check_address(buffer);
+	check_buffer(buffer, size, true);
 	int result = 0;
 
 	if (fd == 0) {
@@ -223,9 +295,19 @@ int read(int fd, void *buffer, unsigned size) {
 		if (f == NULL) {
 			return -1;
 		}
+#ifdef VM
+		// 프레임 락을 잡은 채 폴트가 나지 않도록 버퍼를 미리 올려 고정
+		if (!vm_pin_buffer(buffer, size, true)) {
+			exit(-1);
+		}
+		// 페이지 캐시가 락을 페이지마다 잡고, 디스크를 읽는 동안은 놓는다
+		result = file_read(f, buffer, size);
+		vm_unpin_buffer(buffer, size);
+#else
 		lock_acquire(&filesys_lock);
 		result = file_read(f, buffer, size);
 		lock_release(&filesys_lock);
+#endif
 	}
 	return result;
 }
@@ -233,7 +315,7 @@ int read(int fd, void *buffer, unsigned size) {
 // 파일 쓰기
 int write(int fd, const void *buffer, unsigned size)
 {
-	check_address(buffer);
+	check_buffer(buffer, size, false);
 	int result = 0;
 
 	if (fd == 1) {
@@ -248,9 +330,17 @@ int write(int fd, const void *buffer, unsigned size)
 		if (f == NULL) {
 			return -1;
 		}
+#ifdef VM
+		if (!vm_pin_buffer(buffer, size, false)) {
+			exit(-1);
+		}
+		result = file_write(f, buffer, size);
+		vm_unpin_buffer(buffer, size);
+#else
 		lock_acquire(&filesys_lock);
 		result = file_write(f, buffer, size);
 		lock_release(&filesys_lock);
+#endif
 	}
 	return result;
 }
@@ -290,4 +380,52 @@ void close(int fd) {
 	}
 	file_close(f);
 	process_close_file(fd); // fdt에서 제거하기
-}
\ No newline at end of file
+}
+
+#ifdef VM
+// 파일을 메모리에 매핑
+void *mmap(void *addr, size_t length, int writable, int fd, off_t offset) {
+	struct file *f = process_get_file(fd);
+	uint8_t *end = (uint8_t *)addr + length;
+
+	if (f == NULL || addr == NULL || pg_ofs(addr) != 0 || length == 0) {
+		return NULL;
+	}
+	if (offset < 0 || pg_ofs(offset) != 0) {
+		return NULL;
+	}
+	// 커널 영역을 침범하거나 주소가 넘치는 경우
+	if (!is_user_vaddr(addr) || end < (uint8_t *)addr || !is_user_vaddr(end - 1)) {
+		return NULL;
+	}
+	if (file_length(f) == 0) {
+		return NULL;
+	}
+	return do_mmap(addr, length, writable, f, offset);
+}
+
+// 메모리 매핑 해제
+void munmap(void *addr) {
+	do_munmap(addr);
+}
+
+// 매핑의 변경 내용을 파일에 기록
+int msync(void *addr, size_t length) {
+	return do_msync(addr, length) ? 0 : -1;
+}
+
+// 메모리 사용 방식에 대한 조언
+int madvise(void *addr, size_t length, int advice) {
+	return vm_madvise(addr, length, advice) ? 0 : -1;
+}
+
+// 페이지를 메모리에 고정
+int mlock(void *addr, size_t length) {
+	return vm_mlock(addr, length, true) ? 0 : -1;
+}
+
+// 고정 해제
+int munlock(void *addr, size_t length) {
+	return vm_mlock(addr, length, false) ? 0 : -1;
+}
+#endif
@@ -1,7 +1,13 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
 #include "vm/vm.h"
+#include <bitmap.h>
+#include <stdio.h>
 #include "devices/disk.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/evict.h"
+#include "vm/zswap.h"
 
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
@@ -17,36 +23,221 @@ static const struct page_operations anon_ops = {
 	.type = VM_ANON,
 };
 
+/* The swap disk is divided into slots of one page each, and a bitmap
+ * tracks which slots are in use.  Anonymous pages are written to swap
+ * when they are evicted and read back on the next fault.  A page read
+ * back keeps its slot while swap is less than half full, so that if
+ * it is not written before it is evicted again, it need not be
+ * written out again either. */
+#define SECTORS_PER_SLOT (PGSIZE / DISK_SECTOR_SIZE)
+
+static struct bitmap *swap_slots;  /* Slots in use. */
+static struct lock swap_lock;      /* Protects SWAP_SLOTS and the cluster. */
+
+/* Run of slots set aside by anon_swap_cluster_begin(), which pages
+ * swapped out before anon_swap_cluster_end() take in order. */
+static size_t cluster_next;        /* Next free slot of the run. */
+static size_t cluster_left;        /* Slots left in the run. */
+static size_t cluster_used;        /* Slots of the run used so far. */
+
+/* Statistics. */
+static long long swap_write_cnt;   /* Pages written. */
+static long long swap_read_cnt;    /* Pages read. */
+static long long swap_clean_cnt;   /* Pages evicted clean, not written. */
+static long long cluster_cnt;      /* Clusters of more than one page. */
+
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	lock_init (&swap_lock);
+	zswap_init ();
+	if (swap_disk == NULL)
+		return;
+	swap_slots = bitmap_create (disk_size (swap_disk) / SECTORS_PER_SLOT);
+	if (swap_slots == NULL)
+		PANIC ("swap slot bitmap creation failed");
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = SWAP_NONE;
+	anon_page->zbud = NULL;
+	return true;
+}
+
+/* Reads swap slot SLOT into KVA. */
+static void
+slot_read (size_t slot, void *kva) {
+	for (size_t i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_read (swap_disk, slot * SECTORS_PER_SLOT + i,
+				(uint8_t *) kva + i * DISK_SECTOR_SIZE);
+}
+
+/* Writes KVA to swap slot SLOT. */
+static void
+slot_write (size_t slot, const void *kva) {
+	for (size_t i = 0; i < SECTORS_PER_SLOT; i++)
+		disk_write (swap_disk, slot * SECTORS_PER_SLOT + i,
+				(const uint8_t *) kva + i * DISK_SECTOR_SIZE);
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Frees swap slot SLOT. */
+static void
+slot_free (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (swap_slots, slot));
+	bitmap_reset (swap_slots, slot);
+	lock_release (&swap_lock);
+}
+
+/* Returns true if less than half of swap is in use. */
+static bool
+swap_roomy (void) {
+	size_t used;
+
+	lock_acquire (&swap_lock);
+	used = bitmap_count (swap_slots, 0, bitmap_size (swap_slots), true);
+	lock_release (&swap_lock);
+	return used < bitmap_size (swap_slots) / 2;
+}
+
+/* Sets aside a run of up to PAGE_CNT adjacent swap slots for the pages
+ * swapped out until anon_swap_cluster_end(), so that pages evicted
+ * together are written one after another and lie next to each other,
+ * to be read back together.  The run is shorter if swap is
+ * fragmented. */
+void
+anon_swap_cluster_begin (size_t page_cnt) {
+	ASSERT (cluster_left == 0);
+
+	if (swap_slots == NULL)
+		return;
+	lock_acquire (&swap_lock);
+	for (; page_cnt > 0; page_cnt /= 2) {
+		size_t slot = bitmap_scan_and_flip (swap_slots, 0, page_cnt, false);
+		if (slot != BITMAP_ERROR) {
+			cluster_next = slot;
+			cluster_left = page_cnt;
+			cluster_used = 0;
+			break;
+		}
+	}
+	lock_release (&swap_lock);
+}
+
+/* Gives back the slots set aside by anon_swap_cluster_begin() that
+ * were not used. */
+void
+anon_swap_cluster_end (void) {
+	lock_acquire (&swap_lock);
+	if (cluster_used > 1)
+		cluster_cnt++;
+	if (cluster_left > 0)
+		bitmap_set_multiple (swap_slots, cluster_next, cluster_left, false);
+	cluster_left = cluster_used = 0;
+	lock_release (&swap_lock);
+}
+
+/* Swap in the page by read contents from the compressed cache or
+ * the swap disk. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->zbud != NULL)
+		return zswap_load (page, kva);
+	if (anon_page->slot == SWAP_NONE)
+		return false;
+	slot_read (anon_page->slot, kva);
+	swap_read_cnt++;
+	if (!swap_roomy ()) {
+		slot_free (anon_page->slot);
+		anon_page->slot = SWAP_NONE;
+	}
+	return true;
+}
+
+/* Writes the page of data at KVA to a swap slot, which PAGE then
+ * holds, freeing any slot PAGE held before.  Returns false if swap is
+ * full. */
+bool
+anon_swap_write (struct page *page, const void *kva) {
+	struct anon_page *anon_page = &page->anon;
+	size_t slot;
+
+	if (swap_slots == NULL)
+		return false;
+
+	lock_acquire (&swap_lock);
+	if (cluster_left > 0) {
+		slot = cluster_next++;
+		cluster_left--;
+		cluster_used++;
+	} else
+		slot = bitmap_scan_and_flip (swap_slots, 0, 1, false);
+	lock_release (&swap_lock);
+	if (slot == BITMAP_ERROR)
+		return false;
+
+	slot_write (slot, kva);
+	if (anon_page->slot != SWAP_NONE)
+		slot_free (anon_page->slot);
+	anon_page->slot = slot;
+	swap_write_cnt++;
+	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Swap out the page by compressing it into the cache or, failing
+ * that, writing contents to the swap disk.  A page that is swapped out
+ * again while still resident, because its frame could not be evicted
+ * after all, is stored afresh.  A page that kept its slot when it was
+ * read back and has not been written since is already there. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (anon_page->slot != SWAP_NONE && !frame_is_dirty (page->frame)) {
+		swap_clean_cnt++;
+		return true;
+	}
+	zswap_invalidate (page);
+	if (zswap_store (page)) {
+		if (anon_page->slot != SWAP_NONE)
+			slot_free (anon_page->slot);
+		anon_page->slot = SWAP_NONE;
+		return true;
+	}
+	return anon_swap_write (page, page->frame->kva);
 }
 
-/* Destroy the anonymous page. PAGE will be freed by the caller. */
+/* Destroy the anonymous page. PAGE will be freed by the caller.  Its
+ * swap slot or place in the cache, if any, is freed right away. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	zswap_invalidate (page);
+	if (anon_page->slot != SWAP_NONE)
+		slot_free (anon_page->slot);
+	anon_page->slot = SWAP_NONE;
+}
+
+/* Prints swap statistics. */
+void
+anon_print_stats (void) {
+	zswap_print_stats ();
+	if (swap_slots == NULL)
+		return;
+	printf ("Swap: %zu of %zu slots in use, %lld pages written, "
+			"%lld clusters, %lld pages read, %lld evicted clean\n",
+			bitmap_count (swap_slots, 0, bitmap_size (swap_slots), true),
+			bitmap_size (swap_slots), swap_write_cnt, cluster_cnt,
+			swap_read_cnt, swap_clean_cnt);
 }
@@ -0,0 +1,363 @@
+/* evict.c: Page replacement policies.
+
+   The frame table in vm.c hands each frame that holds a user page to
+   the policy chosen with -evict, and asks that policy for a victim
+   when it runs out of frames.  All a policy has to go on are the
+   accessed and dirty bits of the frames' mappings.
+
+   - clock: second chance.  A hand sweeps all the frames in a ring,
+     looking for one neither used nor written lately, then for one
+     not used lately, clearing accessed bits as it passes.
+
+   - wsclock: clock with a working set window.  A frame used within
+     the last WSCLOCK_TAU ticks is in its process's working set and is
+     left alone; of the rest, clean frames go first.
+
+   - 2q: scan resistant.  New frames go to a FIFO, A1in, that is kept
+     to about a quarter of the frames.  A page evicted from A1in is
+     remembered for a while, in A1out, and if it comes back in that
+     time it goes to Am, which is run by second chance.  A single pass
+     over a large area only churns A1in, leaving Am to the pages that
+     are used again and again.
+
+   - cost: clock that weighs what evicting a frame costs.  Of the
+     frames not used lately that the hand passes, it takes the
+     cheapest: a clean file page, which is dropped, then a clean
+     anonymous page that swap still holds, then a dirty file page,
+     which is written back, and last an anonymous page that has to be
+     written to swap, now and read back later.  A frame passed over
+     COST_AGE times goes as though it were clean, so that costly
+     frames nobody uses do not stay forever. */
+
+#include "vm/evict.h"
+#include <list.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "vm/vm.h"
+
+/* Ticks a frame must go unused before WSClock will evict it. */
+#define WSCLOCK_TAU (TIMER_FREQ / 2)
+
+/* Frames not used lately that the cost policy looks at for each
+ * eviction, and times it passes a frame over before taking it
+ * regardless of cost. */
+#define COST_WINDOW 32
+#define COST_AGE 3
+
+/* Clock and WSClock: the frames in a ring, and the hand, which points
+ * to the next frame to look at or to the end of the list. */
+static struct list ring;
+static struct list_elem *hand;
+static size_t ring_cnt;
+
+static void
+ring_init (void) {
+	list_init (&ring);
+	hand = list_end (&ring);
+	ring_cnt = 0;
+}
+
+/* Adds FRAME just behind the hand, so that it is the last frame the
+ * hand gets to. */
+static void
+ring_add (struct frame *frame) {
+	list_insert (hand, &frame->elem);
+	ring_cnt++;
+}
+
+/* Removes FRAME from the ring, moving the hand past it if it is
+ * there. */
+static void
+ring_remove (struct frame *frame) {
+	if (hand == &frame->elem)
+		hand = list_next (hand);
+	list_remove (&frame->elem);
+	ring_cnt--;
+}
+
+/* Returns the frame under the hand and moves the hand on, wrapping
+ * around at the end of the ring, which must not be empty. */
+static struct frame *
+ring_advance (void) {
+	struct list_elem *e;
+
+	ASSERT (ring_cnt > 0);
+
+	if (hand == list_end (&ring))
+		hand = list_begin (&ring);
+	e = hand;
+	hand = list_next (e);
+	return list_entry (e, struct frame, elem);
+}
+
+/* Two rounds of looking for a clean frame and then for any frame not
+ * used lately find a victim unless every frame is pinned or in use
+ * again by then, so one eviction looks at no more than four times as
+ * many frames as there are. */
+static struct frame *
+clock_victim (long long *scanned) {
+	int pass;
+
+	for (pass = 0; pass < 4 && ring_cnt > 0; pass++) {
+		bool want_clean = pass % 2 == 0;
+		size_t i, cnt = ring_cnt;
+
+		for (i = 0; i < cnt; i++) {
+			struct frame *frame = ring_advance ();
+
+			++*scanned;
+			if (frame_is_pinned (frame))
+				continue;
+			if (frame_is_accessed (frame)) {
+				if (!want_clean)
+					frame_clear_accessed (frame);
+				continue;
+			}
+			if (want_clean && frame_is_dirty (frame))
+				continue;
+			return frame;
+		}
+	}
+	return NULL;
+}
+
+static void
+wsclock_add (struct frame *frame) {
+	frame->stamp = timer_ticks ();
+	ring_add (frame);
+}
+
+/* The hand goes around once, noting when it finds each frame used.
+ * The first frame outside the working set that is clean is taken at
+ * once.  Real WSClock would start writing back the dirty ones and
+ * keep going; we write synchronously, so the first old dirty frame is
+ * taken only when there is no clean one, and failing that the frame
+ * that has gone unused the longest. */
+static struct frame *
+wsclock_victim (long long *scanned) {
+	int64_t now = timer_ticks ();
+	struct frame *dirty = NULL, *oldest = NULL;
+	size_t i, cnt = ring_cnt;
+
+	for (i = 0; i < cnt; i++) {
+		struct frame *frame = ring_advance ();
+
+		++*scanned;
+		if (frame_is_pinned (frame))
+			continue;
+		if (frame_is_accessed (frame)) {
+			frame_clear_accessed (frame);
+			frame->stamp = now;
+		} else if (now - frame->stamp > WSCLOCK_TAU) {
+			if (!frame_is_dirty (frame))
+				return frame;
+			if (dirty == NULL)
+				dirty = frame;
+		}
+		if (oldest == NULL || frame->stamp < oldest->stamp)
+			oldest = frame;
+	}
+	return dirty != NULL ? dirty : oldest;
+}
+
+/* Reclaim costs, cheapest first. */
+enum cost_class {
+	COST_CLEAN_FILE,            /* Read back from its file. */
+	COST_CLEAN_ANON,            /* Already in swap. */
+	COST_DIRTY_FILE,            /* Written back to its file. */
+	COST_DIRTY_ANON,            /* Written to swap. */
+	COST_CLASSES
+};
+
+/* Returns what evicting FRAME would cost. */
+static enum cost_class
+frame_cost (const struct frame *frame) {
+	bool dirty = frame_is_dirty (frame);
+	struct page *p;
+
+	if (VM_TYPE (frame->page->operations->type) != VM_ANON)
+		return dirty ? COST_DIRTY_FILE : COST_CLEAN_FILE;
+	if (dirty)
+		return COST_DIRTY_ANON;
+
+	/* Each page sharing the frame goes to a slot of its own. */
+	for (p = frame->page; p != NULL; p = p->share_next)
+		if (p->anon.slot == SWAP_NONE)
+			return COST_DIRTY_ANON;
+	return COST_CLEAN_ANON;
+}
+
+static void
+cost_add (struct frame *frame) {
+	frame->queue = 0;
+	ring_add (frame);
+}
+
+/* Looks at up to COST_WINDOW frames not used lately, clearing the
+ * accessed bits of the used ones it passes, and takes the cheapest,
+ * or the first clean file page at once.  In two rounds of the ring
+ * every frame has been seen unused unless it is pinned or used again
+ * each time, so one eviction looks at no more than twice as many
+ * frames as there are. */
+static struct frame *
+cost_victim (long long *scanned) {
+	struct frame *best = NULL;
+	enum cost_class best_cost = COST_CLASSES;
+	size_t i, seen = 0, cnt = 2 * ring_cnt;
+
+	for (i = 0; i < cnt && seen < COST_WINDOW; i++) {
+		struct frame *frame = ring_advance ();
+		enum cost_class cost;
+
+		++*scanned;
+		if (frame_is_pinned (frame))
+			continue;
+		if (frame_is_accessed (frame)) {
+			frame_clear_accessed (frame);
+			frame->queue = 0;
+			continue;
+		}
+		cost = frame->queue >= COST_AGE
+			? COST_CLEAN_FILE : frame_cost (frame);
+		frame->queue++;
+		seen++;
+		if (cost < best_cost) {
+			best = frame;
+			best_cost = cost;
+		}
+		if (best_cost == COST_CLEAN_FILE)
+			break;
+	}
+	return best;
+}
+
+/* 2Q queues. */
+enum twoq_queue {
+	Q_A1IN,                     /* Frames on probation, FIFO. */
+	Q_AM                        /* Frames in use, second chance. */
+};
+
+static struct list a1in, am;
+static size_t a1in_cnt, am_cnt;
+
+/* Counts evictions from A1in.  A page is in A1out while fewer
+ * evictions than A1out holds have followed its own. */
+static uint64_t a1out_clock;
+
+static void
+twoq_init (void) {
+	list_init (&a1in);
+	list_init (&am);
+}
+
+static void
+twoq_add (struct frame *frame) {
+	uint64_t stamp = frame->page->evict_stamp;
+	size_t kout = (a1in_cnt + am_cnt) / 2 + 1;
+
+	if (stamp != 0 && a1out_clock - stamp < kout) {
+		frame->queue = Q_AM;
+		list_push_back (&am, &frame->elem);
+		am_cnt++;
+	} else {
+		frame->queue = Q_A1IN;
+		list_push_back (&a1in, &frame->elem);
+		a1in_cnt++;
+	}
+}
+
+static void
+twoq_remove (struct frame *frame) {
+	list_remove (&frame->elem);
+	if (frame->queue == Q_A1IN) {
+		a1in_cnt--;
+		frame->page->evict_stamp = ++a1out_clock;
+	} else
+		am_cnt--;
+}
+
+/* Takes the oldest frame of A1in while A1in is over its share, and
+ * otherwise sweeps Am.  Whatever is looked at moves to the back of its
+ * queue, so a victim that cannot be written out is not picked again
+ * right away.  Each frame of A1in is looked at no more than once and
+ * each frame of Am no more than twice. */
+static struct frame *
+twoq_victim (long long *scanned) {
+	size_t kin = (a1in_cnt + am_cnt) / 4 + 1;
+	size_t a1in_left = a1in_cnt, am_left = 2 * am_cnt;
+
+	while (a1in_left > 0 || am_left > 0) {
+		bool from_a1in = a1in_left > 0
+			&& (a1in_cnt > kin || am_left == 0);
+		struct list *q = from_a1in ? &a1in : &am;
+		struct frame *frame = list_entry (list_pop_front (q),
+				struct frame, elem);
+
+		list_push_back (q, &frame->elem);
+		++*scanned;
+		if (from_a1in)
+			a1in_left--;
+		else
+			am_left--;
+
+		if (frame_is_pinned (frame))
+			continue;
+		if (!from_a1in && frame_is_accessed (frame)) {
+			frame_clear_accessed (frame);
+			continue;
+		}
+		return frame;
+	}
+	return NULL;
+}
+
+static const struct evict_policy clock_policy = {
+	.name = "clock",
+	.init = ring_init,
+	.add = ring_add,
+	.remove = ring_remove,
+	.victim = clock_victim,
+};
+
+static const struct evict_policy wsclock_policy = {
+	.name = "wsclock",
+	.init = ring_init,
+	.add = wsclock_add,
+	.remove = ring_remove,
+	.victim = wsclock_victim,
+};
+
+static const struct evict_policy twoq_policy = {
+	.name = "2q",
+	.init = twoq_init,
+	.add = twoq_add,
+	.remove = twoq_remove,
+	.victim = twoq_victim,
+};
+
+static const struct evict_policy cost_policy = {
+	.name = "cost",
+	.init = ring_init,
+	.add = cost_add,
+	.remove = ring_remove,
+	.victim = cost_victim,
+};
+
+static const struct evict_policy *const policies[] = {
+	&clock_policy, &wsclock_policy, &twoq_policy, &cost_policy,
+};
+
+const struct evict_policy *evict_policy = &clock_policy;
+
+/* Returns the policy called NAME, or NULL if there is none. */
+const struct evict_policy *
+evict_policy_find (const char *name) {
+	size_t i;
+
+	if (name == NULL)
+		return NULL;
+	for (i = 0; i < sizeof policies / sizeof *policies; i++)
+		if (!strcmp (policies[i]->name, name))
+			return policies[i];
+	return NULL;
+}
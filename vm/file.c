@@ -1,5 +1,16 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/inode.h"
+#include "filesys/page_cache.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "userprog/syscall.h"
 #include "vm/vm.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
@@ -14,45 +25,421 @@ static const struct page_operations file_ops = {
 	.type = VM_FILE,
 };
 
+/* Most pages written back with one write. */
+#define WRITEBACK_PAGES 8
+
+/* Dirty pages of a file mapping on their way back to the file.  Pages
+ * that are next to each other are gathered into BUF and written
+ * together. */
+struct writeback {
+	struct vm_area *area;       /* The mapping. */
+	uint8_t *buf;               /* WRITEBACK_PAGES pages, or NULL. */
+	size_t first;               /* Page number in AREA of the run's first. */
+	size_t cnt;                 /* Pages in the run. */
+	bool ok;                    /* Has every write succeeded? */
+};
+
+int flush_age = 30;
+
+/* The file mappings of every process, for the flusher.  The lock may
+ * be taken with the frame lock held, and the file system lock with
+ * it, not the other way around. */
+static struct list file_areas;
+static struct lock file_areas_lock;
+
+/* Statistics. */
+static long long writeback_cnt;   /* Pages written back. */
+static long long write_cnt;       /* Writes that wrote them. */
+static long long flush_cnt;       /* Pages written back by the flusher. */
+
 /* The initializer of file vm */
 void
 vm_file_init (void) {
+	list_init (&file_areas);
+	lock_init (&file_areas_lock);
+}
+
+/* AREA, a file mapping, now exists. */
+void
+file_area_add (struct vm_area *area) {
+	lock_acquire (&file_areas_lock);
+	list_push_back (&file_areas, &area->file_elem);
+	lock_release (&file_areas_lock);
+}
+
+/* AREA, a file mapping, is going away. */
+void
+file_area_remove (struct vm_area *area) {
+	lock_acquire (&file_areas_lock);
+	list_remove (&area->file_elem);
+	lock_release (&file_areas_lock);
 }
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	file_page->dirty_since = 0;
+	return true;
+}
+
+/* Starts gathering dirty pages of AREA in WB. */
+static void
+writeback_init (struct writeback *wb, struct vm_area *area) {
+	wb->area = area;
+	wb->buf = NULL;
+	wb->cnt = 0;
+	wb->ok = true;
+}
+
+/* Writes the run gathered in WB, at SRC, to the file. */
+static void
+writeback_flush (struct writeback *wb, const void *src) {
+	struct vm_area *area = wb->area;
+	size_t ofs = wb->first * PGSIZE;
+	size_t bytes = area->read_bytes - ofs;
+
+	if (wb->cnt == 0)
+		return;
+	if (bytes > wb->cnt * PGSIZE)
+		bytes = wb->cnt * PGSIZE;
+	if (vm_file_write_at (area->file, src, bytes, area->offset + ofs)
+			!= (off_t) bytes)
+		wb->ok = false;
+	writeback_cnt += wb->cnt;
+	write_cnt++;
+	wb->cnt = 0;
+}
+
+/* Adds PAGE, which is resident and lies in the part of its mapping
+ * backed by the file, to WB if it is dirty.  Its dirty bit is cleared
+ * before its contents are taken, so that a write that comes after
+ * makes it dirty again. */
+static void
+writeback_add (struct writeback *wb, struct page *page) {
+	struct vm_area *area = wb->area;
+	uint64_t *pml4 = area->spt->owner->pml4;
+	size_t idx = pg_no (page->va) - pg_no (area->start);
+
+	ASSERT (page->area == area && page->frame != NULL);
+
+	if (pml4 == NULL || !pml4_is_dirty (pml4, page->va)
+			|| idx * PGSIZE >= area->read_bytes)
+		return;
+	pml4_set_dirty (pml4, page->va, false);
+	page->file.dirty_since = 0;
+
+	if (wb->cnt > 0
+			&& (wb->first + wb->cnt != idx || wb->cnt == WRITEBACK_PAGES))
+		writeback_flush (wb, wb->buf);
+	if (wb->cnt == 0) {
+		wb->first = idx;
+		if (wb->buf == NULL)
+			wb->buf = palloc_get_multiple (0, WRITEBACK_PAGES);
+	}
+	if (wb->buf == NULL) {
+		/* No room to gather pages: write this one on its own. */
+		wb->cnt = 1;
+		writeback_flush (wb, page->frame->kva);
+		return;
+	}
+	memcpy (wb->buf + wb->cnt * PGSIZE, page->frame->kva, PGSIZE);
+	wb->cnt++;
+}
+
+/* Writes what is left in WB and returns true if every write
+ * succeeded. */
+static bool
+writeback_finish (struct writeback *wb) {
+	writeback_flush (wb, wb->buf);
+	if (wb->buf != NULL)
+		palloc_free_multiple (wb->buf, WRITEBACK_PAGES);
+	return wb->ok;
+}
+
+/* Writes the dirty pages of file mapping AREA from START up to END
+ * back to its file, runs of adjacent pages with one write each.  The
+ * frame lock must be held.  Returns false if a write fails. */
+bool
+file_area_writeback (struct vm_area *area, void *start, void *end) {
+	struct supplemental_page_table *spt = area->spt;
+	uint64_t key = pg_no (start), last = pg_no (end) - 1;
+	struct writeback wb;
+	struct page *page;
+
+	ASSERT (VM_TYPE (area->type) == VM_FILE);
+
+	writeback_init (&wb, area);
+	for (; (page = radix_next (&spt->pages, &key, last, RADIX_ANY)) != NULL;
+			key++)
+		if (page->frame != NULL
+				&& VM_TYPE (page->operations->type) == VM_FILE)
+			writeback_add (&wb, page);
+	return writeback_finish (&wb);
+}
+
+/* Copies BYTES bytes of the dirty page at KVA, which lies at OFS in
+ * INODE, into FB.  Pages that follow each other in a file share a run
+ * of up to WRITEBACK_PAGES pages.  Returns false, with FB marked full,
+ * if there is no room for the page, which the caller then leaves dirty
+ * for the next batch. */
+bool
+flush_batch_add (struct flush_batch *fb, struct inode *inode, off_t ofs,
+		const void *kva, off_t bytes) {
+	struct flush_run *run = fb->cnt > 0 ? &fb->runs[fb->cnt - 1] : NULL;
+
+	if (run == NULL || run->inode != inode || run->cnt == run->max
+			|| run->ofs + (off_t) (run->cnt * PGSIZE) != ofs) {
+		size_t max = WRITEBACK_PAGES;
+		uint8_t *buf = NULL;
+
+		if (fb->cnt < FLUSH_RUNS) {
+			buf = palloc_get_multiple (0, max);
+			if (buf == NULL)
+				buf = palloc_get_multiple (0, max = 1);
+		}
+		if (buf == NULL) {
+			fb->full = true;
+			return false;
+		}
+		run = &fb->runs[fb->cnt++];
+		run->inode = inode;
+		run->ofs = ofs;
+		run->buf = buf;
+		run->cnt = 0;
+		run->max = max;
+	}
+	memcpy (run->buf + run->cnt * PGSIZE, kva, bytes);
+	run->bytes = run->cnt * PGSIZE + bytes;
+	run->cnt++;
+	return true;
+}
+
+/* Writes the runs in FB to their files and frees them.  The file
+ * system lock must be held. */
+static void
+flush_batch_write (struct flush_batch *fb) {
+	for (size_t i = 0; i < fb->cnt; i++) {
+		struct flush_run *run = &fb->runs[i];
+
+		page_cache_write_direct (run->inode, run->buf, run->bytes, run->ofs);
+		palloc_free_multiple (run->buf, run->max);
+		writeback_cnt += run->cnt;
+		flush_cnt += run->cnt;
+		write_cnt++;
+	}
+}
+
+/* Copies into FB the pages of AREA that have been dirty for flush_age
+ * seconds or more, as of NOW, clearing their dirty bits, and notes
+ * when the others got dirty.  A page is seen to get dirty only by the
+ * flusher's visits, so it may have been dirty up to a visit longer.
+ * Stops when FB is full. */
+static void
+file_area_flush (struct vm_area *area, struct flush_batch *fb, int64_t now) {
+	struct supplemental_page_table *spt = area->spt;
+	uint64_t key = pg_no (area->start), last = pg_no (area->end) - 1;
+	uint64_t *pml4 = spt->owner->pml4;
+	struct page *page;
+
+	if (pml4 == NULL)
+		return;
+	for (; (page = radix_next (&spt->pages, &key, last, RADIX_ANY)) != NULL;
+			key++) {
+		struct file_page *file_page = &page->file;
+		size_t ofs = (pg_no (page->va) - pg_no (area->start)) * PGSIZE;
+		size_t bytes = area->read_bytes - ofs;
+
+		if (page->frame == NULL
+				|| VM_TYPE (page->operations->type) != VM_FILE)
+			continue;
+		if (!pml4_is_dirty (pml4, page->va))
+			file_page->dirty_since = 0;
+		else if (file_page->dirty_since == 0)
+			file_page->dirty_since = now;
+		else if (now - file_page->dirty_since >= flush_age * TIMER_FREQ
+				&& ofs < area->read_bytes) {
+			if (bytes > PGSIZE)
+				bytes = PGSIZE;
+			if (!flush_batch_add (fb, file_get_inode (area->file),
+						area->offset + ofs, page->frame->kva, bytes))
+				return;
+			pml4_set_dirty (pml4, page->va, false);
+			file_page->dirty_since = 0;
+		}
+	}
+}
+
+/* Writes back the pages of file mappings and of the page cache that
+ * have been dirty for flush_age seconds, so that a crash or power cut
+ * loses no more than flush_age seconds of writes to them.  Called by
+ * the page cache worker, once a second.
+ *
+ * The pages are copied, a batch at a time, with the frame lock held,
+ * and written once it is released, so that faults and evictions do
+ * not wait for the disk.  The file system lock is held from before the
+ * copies until the writes are done.  That keeps the files open, and
+ * any later writeback of the same pages, which needs the lock to
+ * write, reaches the disk after these copies. */
+void
+vm_file_flush (void) {
+	int64_t now = timer_ticks ();
+	struct flush_batch fb;
+	struct list_elem *e;
+
+	if (flush_age <= 0)
+		return;
+	do {
+		fb.cnt = 0;
+		fb.full = false;
+		vm_lock ();
+		lock_acquire (&file_areas_lock);
+		lock_acquire (&filesys_lock);
+		for (e = list_begin (&file_areas);
+				!fb.full && e != list_end (&file_areas); e = list_next (e))
+			file_area_flush (list_entry (e, struct vm_area, file_elem),
+					&fb, now);
+		lock_release (&file_areas_lock);
+		if (!fb.full)
+			page_cache_flush (&fb, now);
+		vm_unlock ();
+		flush_batch_write (&fb);
+		lock_release (&filesys_lock);
+	} while (fb.full && fb.cnt > 0);
+}
+
+/* Writes PAGE, which is resident, back to its file if it is dirty.
+ * Only the part of the page that lies within the mapped part of the
+ * file is written, so the file never grows. */
+static bool
+file_backed_writeback (struct page *page) {
+	struct writeback wb;
+
+	writeback_init (&wb, page->area);
+	writeback_add (&wb, page);
+	return writeback_finish (&wb);
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	return vm_area_read_page (page, kva);
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.  In a file
+ * mapping, its dirty neighbours among the WRITEBACK_PAGES pages it is
+ * aligned with go in the same writes, since they would likely be
+ * evicted soon after it, a write each. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct vm_area *area = page->area;
+	uint8_t *start, *end;
+
+	if (VM_TYPE (area->type) != VM_FILE)
+		return file_backed_writeback (page);
+	start = (uint8_t *) area->start + (pg_no (page->va) - pg_no (area->start))
+		/ WRITEBACK_PAGES * WRITEBACK_PAGES * PGSIZE;
+	end = start + WRITEBACK_PAGES * PGSIZE;
+	if (end > (uint8_t *) area->end)
+		end = area->end;
+	return file_area_writeback (area, start, end);
 }
 
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	if (page->frame != NULL)
+		file_backed_writeback (page);
 }
 
-/* Do the mmap */
+/* Do the mmap.  Maps LENGTH bytes of FILE starting at OFFSET at ADDR,
+ * with the part of the last page past the end of the file zeroed.
+ * Nothing is read until the pages are touched.  The mapping keeps its
+ * own reference to the file, so it outlives closing FILE.  A running
+ * program cannot be mapped writable, since its text shares the
+ * mapping's frames. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	struct file *backing;
+	off_t file_len;
+	size_t read_bytes;
+
+	if (writable && inode_write_denied (file_get_inode (file)))
+		return NULL;
+	lock_acquire (&filesys_lock);
+	backing = file_reopen (file);
+	lock_release (&filesys_lock);
+	if (backing == NULL)
+		return NULL;
+	file_len = file_length (backing);
+	read_bytes = offset < file_len ? (size_t) (file_len - offset) : 0;
+	if (read_bytes > length)
+		read_bytes = length;
+
+	if (spt_add_area (&thread_current ()->spt, addr,
+				pg_round_up ((uint8_t *) addr + length), VM_FILE, writable,
+				backing, offset, read_bytes) == NULL) {
+		lock_acquire (&filesys_lock);
+		file_close (backing);
+		lock_release (&filesys_lock);
+		return NULL;
+	}
+	return addr;
 }
 
-/* Do the munmap */
+/* Do the msync.  Writes the dirty pages of the LENGTH bytes at ADDR,
+ * which must be page-aligned and lie wholly in file mappings, back to
+ * their files.  Returns false if the range is bad or a write
+ * fails. */
+bool
+do_msync (void *addr, size_t length) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *start = addr, *end = start + length;
+	bool success = true;
+
+	if (pg_ofs (addr) != 0 || end < start)
+		return false;
+	end = pg_round_up (end);
+
+	vm_lock ();
+	while (start < end) {
+		struct vm_area *area = spt_find_area (spt, start);
+		uint8_t *stop;
+
+		if (area == NULL || VM_TYPE (area->type) != VM_FILE) {
+			success = false;
+			break;
+		}
+		stop = end < (uint8_t *) area->end ? end : (uint8_t *) area->end;
+		if (!file_area_writeback (area, start, stop))
+			success = false;
+		start = stop;
+	}
+	vm_unlock ();
+	return success;
+}
+
+/* Prints writeback statistics. */
+void
+file_print_stats (void) {
+	printf ("Writeback: %lld pages in %lld writes, %lld by the flusher\n",
+			writeback_cnt, write_cnt, flush_cnt);
+}
+
+/* Do the munmap.  ADDR must be the address returned by the mmap()
+ * call; the whole mapping goes away, and its dirty pages are written
+ * back. */
 void
 do_munmap (void *addr) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_area *area = spt_find_area (spt, addr);
+
+	if (area != NULL && area->start == addr
+			&& VM_TYPE (area->type) == VM_FILE)
+		spt_remove_area (spt, area);
 }
@@ -0,0 +1,191 @@
+/* ksm.c: Kernel same-page merging.
+
+   Processes that fork, or that run the same program on the same
+   data, end up with many anonymous pages that hold the same bytes.
+   The ksmd thread goes round the anonymous frames a few at a time,
+   looking for such pages, and merges each one it finds into a single
+   read-only frame that the pages share, just as fork() shares them.
+   A write to a merged page then gets it a copy of its own through
+   the usual copy-on-write fault.
+
+   Pages are found by a checksum of their contents.  A frame whose
+   checksum is the same on two scans in a row is not changing much,
+   so it goes into a table of candidates, keyed by checksum.  A frame
+   whose checksum matches a candidate is compared with it byte for
+   byte and, if it is the same, merged into it.  Pages that change
+   between scans are never merged, which keeps them from being merged
+   only to be copied again on the next write. */
+
+#include "vm/ksm.h"
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vm.h"
+
+/* Times a second that ksmd wakes up. */
+#define KSM_WAKEUPS 10
+
+int ksm_rate;
+
+/* The frames that hold pages, in the order they were added, and the
+ * next one ksmd is to look at, or the end of the list. */
+static struct list ksm_frames;
+static struct list_elem *ksm_cursor;
+
+/* Candidates, by checksum. */
+static struct hash ksm_table;
+
+/* Statistics. */
+static long long scan_cnt;      /* Frames looked at. */
+static long long merge_cnt;     /* Pages merged into another frame. */
+static long long unmerge_cnt;   /* Writes to merged pages. */
+
+static void ksmd (void *aux);
+static uint64_t ksm_hash (const struct hash_elem *, void *aux);
+static bool ksm_less (const struct hash_elem *, const struct hash_elem *,
+		void *aux);
+
+/* Starts ksmd, if merging is turned on. */
+void
+ksm_init (void) {
+	list_init (&ksm_frames);
+	ksm_cursor = list_end (&ksm_frames);
+	if (ksm_rate <= 0)
+		return;
+	if (!hash_init (&ksm_table, ksm_hash, ksm_less, NULL)
+			|| thread_create ("ksmd", PRI_MIN, ksmd, NULL) == TID_ERROR)
+		PANIC ("cannot start ksmd");
+}
+
+/* FRAME now holds a page. */
+void
+ksm_add (struct frame *frame) {
+	frame->ksm_sum = 0;
+	frame->ksm_listed = false;
+	frame->ksm_merged = false;
+	if (ksm_rate > 0)
+		list_insert (ksm_cursor, &frame->ksm_elem);
+}
+
+/* FRAME's page is going away. */
+void
+ksm_remove (struct frame *frame) {
+	if (ksm_rate <= 0)
+		return;
+	if (ksm_cursor == &frame->ksm_elem)
+		ksm_cursor = list_next (ksm_cursor);
+	list_remove (&frame->ksm_elem);
+	if (frame->ksm_listed)
+		hash_delete (&ksm_table, &frame->ksm_hash_elem);
+}
+
+/* A page that shares FRAME is being written, so it will have a frame
+ * of its own after this. */
+void
+ksm_write_fault (struct frame *frame) {
+	if (!frame->ksm_merged)
+		return;
+	unmerge_cnt++;
+	if (frame->share_cnt <= 2)
+		frame->ksm_merged = false;
+}
+
+/* Returns true if ksmd may merge FRAME, or merge pages into it. */
+static bool
+ksm_mergeable (const struct frame *frame) {
+	return frame->pinned == 0 && frame->lock_cnt == 0 && !frame->page->huge
+		&& VM_TYPE (frame->page->operations->type) == VM_ANON;
+}
+
+/* Looks at FRAME, merging it into a candidate with the same contents
+ * or making it a candidate itself. */
+static void
+ksm_scan (struct frame *frame) {
+	struct hash_elem *e;
+	struct frame *match;
+	uint64_t sum;
+
+	if (!ksm_mergeable (frame))
+		return;
+	scan_cnt++;
+	sum = hash_bytes (frame->kva, PGSIZE);
+	if (sum != frame->ksm_sum) {
+		/* Changed since last time. */
+		if (frame->ksm_listed)
+			hash_delete (&ksm_table, &frame->ksm_hash_elem);
+		frame->ksm_listed = false;
+		frame->ksm_sum = sum;
+		return;
+	}
+	if (frame->ksm_listed)
+		return;
+
+	e = hash_insert (&ksm_table, &frame->ksm_hash_elem);
+	if (e == NULL) {
+		frame->ksm_listed = true;
+		return;
+	}
+	match = hash_entry (e, struct frame, ksm_hash_elem);
+	if (ksm_mergeable (match)) {
+		int cnt = frame->share_cnt;
+
+		if (frame_merge (match, frame)) {
+			match->ksm_merged = true;
+			merge_cnt += cnt;
+			return;
+		}
+	}
+
+	/* MATCH has changed since it was listed.  FRAME takes its place. */
+	hash_replace (&ksm_table, &frame->ksm_hash_elem);
+	match->ksm_listed = false;
+	frame->ksm_listed = true;
+}
+
+/* The merging thread.  Scans ksm_rate frames a second, in batches,
+ * holding the frame lock for one batch at a time. */
+static void
+ksmd (void *aux UNUSED) {
+	int batch = ksm_rate / KSM_WAKEUPS > 0 ? ksm_rate / KSM_WAKEUPS : 1;
+
+	for (;;) {
+		int i;
+
+		timer_sleep (TIMER_FREQ / KSM_WAKEUPS);
+		vm_lock ();
+		for (i = 0; i < batch && !list_empty (&ksm_frames); i++) {
+			struct list_elem *e;
+
+			if (ksm_cursor == list_end (&ksm_frames))
+				ksm_cursor = list_begin (&ksm_frames);
+			e = ksm_cursor;
+			ksm_cursor = list_next (e);
+			ksm_scan (list_entry (e, struct frame, ksm_elem));
+		}
+		vm_unlock ();
+	}
+}
+
+static uint64_t
+ksm_hash (const struct hash_elem *e, void *aux UNUSED) {
+	return hash_entry (e, struct frame, ksm_hash_elem)->ksm_sum;
+}
+
+static bool
+ksm_less (const struct hash_elem *a, const struct hash_elem *b,
+		void *aux UNUSED) {
+	return hash_entry (a, struct frame, ksm_hash_elem)->ksm_sum
+		< hash_entry (b, struct frame, ksm_hash_elem)->ksm_sum;
+}
+
+/* Prints merging statistics. */
+void
+ksm_print_stats (void) {
+	if (ksm_rate <= 0)
+		return;
+	printf ("KSM: %lld frames scanned, %lld pages merged, "
+			"%lld unmerged on write\n", scan_cnt, merge_cnt, unmerge_cnt);
+}
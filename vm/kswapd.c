@@ -0,0 +1,109 @@
+/* kswapd.c: Background page-out.
+
+   Without it, a fault that finds no free frame evicts a page itself
+   and waits for the page to be written out before it can go on.  The
+   kswapd thread keeps some frames free instead, so that most faults
+   find one at hand.  It wakes when fewer than kswapd_low user pages
+   are free and evicts pages, a batch at a time, until kswapd_high are
+   free.  Dirty anonymous victims go to swap in runs of adjacent slots,
+   and dirty file pages go back with their dirty neighbours, as they
+   do when a fault evicts them.
+
+   kswapd takes the frame lock for one batch at a time, so that faults
+   may come in between.  A fault that still finds no free frame evicts
+   one itself, as before. */
+
+#include "vm/kswapd.h"
+#include <stdio.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "vm/vm.h"
+
+/* Most frames freed with the frame lock held. */
+#define KSWAPD_BATCH 16
+
+size_t kswapd_low;
+size_t kswapd_high;
+
+/* Upped to wake kswapd.  AWAKE is true from then until it is done,
+ * and is protected by the frame lock. */
+static struct semaphore kswapd_sema;
+static bool awake;
+
+/* Statistics. */
+static long long wakeup_cnt;    /* Times kswapd woke up. */
+static long long reclaim_cnt;   /* Frames it freed. */
+static long long direct_cnt;    /* Frames asked for when none was free. */
+
+static void kswapd (void *aux);
+
+/* Starts kswapd, if it is turned on.  The watermarks are cut down to
+ * fit the user pool: the high one to the size of the pool, and the low
+ * one to below the high one, so that kswapd does not evict every page
+ * each time it wakes up. */
+void
+kswapd_init (void) {
+	size_t pool = palloc_user_cnt ();
+
+	sema_init (&kswapd_sema, 0);
+	if (kswapd_low == 0)
+		return;
+	if (kswapd_high <= kswapd_low)
+		kswapd_high = kswapd_low * 2;
+	if (kswapd_high > pool)
+		kswapd_high = pool;
+	if (kswapd_low >= kswapd_high)
+		kswapd_low = kswapd_high / 2;
+	if (kswapd_low == 0)
+		return;
+	if (thread_create ("kswapd", PRI_DEFAULT, kswapd, NULL) == TID_ERROR)
+		PANIC ("cannot start kswapd");
+}
+
+/* A frame was asked for, and GOT_FRAME tells whether a free one was
+ * found.  Wakes kswapd if free pages are running short.  The frame
+ * lock must be held. */
+void
+kswapd_check (bool got_frame) {
+	if (kswapd_low == 0)
+		return;
+	if (!got_frame)
+		direct_cnt++;
+	if (!awake && palloc_user_free_cnt () < kswapd_low) {
+		awake = true;
+		sema_up (&kswapd_sema);
+	}
+}
+
+/* The page-out thread. */
+static void
+kswapd (void *aux UNUSED) {
+	for (;;) {
+		sema_down (&kswapd_sema);
+		wakeup_cnt++;
+		vm_lock ();
+		while (palloc_user_free_cnt () < kswapd_high) {
+			size_t cnt = vm_reclaim (KSWAPD_BATCH);
+
+			reclaim_cnt += cnt;
+			if (cnt == 0)
+				break;
+			vm_unlock ();
+			thread_yield ();
+			vm_lock ();
+		}
+		awake = false;
+		vm_unlock ();
+	}
+}
+
+/* Prints page-out statistics. */
+void
+kswapd_print_stats (void) {
+	if (kswapd_low == 0)
+		return;
+	printf ("Kswapd: %lld wakeups, %lld frames freed, "
+			"%lld asked for when none was free\n",
+			wakeup_cnt, reclaim_cnt, direct_cnt);
+}
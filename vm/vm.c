@@ -1,8 +1,100 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#include "userprog/syscall.h"
+#include <syscall-nr.h>
 #include "vm/vm.h"
+#include "vm/evict.h"
 #include "vm/inspect.h"
+#include "vm/ksm.h"
+#include "vm/kswapd.h"
+
+/* Largest size the user stack may grow to. */
+#define STACK_MAX (1 << 20)
+
+/* Victims an eviction may try before giving up, when pages cannot
+ * be written out or huge pages cannot be split. */
+#define EVICT_TRIES 8
+
+/* Most anonymous pages evicted, and written to swap, together; and
+ * most neighbors of a page read back from swap along with it, in each
+ * direction. */
+#define SWAP_CLUSTER 8
+
+/* Most of the user pool that one process may lock with mlock(), as a
+ * fraction. */
+#define MLOCK_LIMIT_DIV 4
+
+/* Protects the frame table, which is kept by the replacement policy
+ * in evict.c, and the pages of every process along with their links
+ * to frames.  Page faults, eviction,
+ * and the copying and teardown of address spaces hold it throughout.
+ * The file system lock may be taken while holding it, never the other
+ * way around, which is why system calls pin their buffers before
+ * they take the file system lock. */
+static struct lock frame_lock;
+
+size_t fault_around_pages;
+size_t readahead_max;
+
+/* Readahead windows, in pages, start at RA_MIN_WINDOW and double while
+ * faults stay sequential, up to readahead_max.  An area that madvise()
+ * says is read sequentially gets windows of at least RA_SEQ_WINDOW
+ * pages, which is also how much MADV_WILLNEED asks for in one read. */
+#define RA_MIN_WINDOW 4
+#define RA_SEQ_WINDOW 16
+
+/* A request to read pages FIRST up to FIRST + CNT of AREA in the
+ * background. */
+struct readahead {
+	struct list_elem elem;      /* In ra_queue. */
+	struct vm_area *area;       /* Set to NULL if the area goes away. */
+	size_t first, cnt;
+};
+
+/* Readahead requests, oldest first, and the one being read, if any,
+ * under the frame lock.  RA_SEMA counts the requests queued. */
+static struct list ra_queue;
+static struct readahead *ra_current;
+static struct semaphore ra_sema;
+static bool ra_started;
+
+static void readahead_start (void);
+static void readahead_daemon (void *aux);
+static void readahead_cancel (struct vm_area *area);
+
+/* A page of zeros that is never written.  A read fault on a page that
+ * would start out zero-filled maps it here, read-only, and the page
+ * gets a frame of its own only when it is first written. */
+static void *zero_kva;
+
+/* Statistics. */
+static long long fault_cnt;       /* Page faults handled. */
+static long long read_back_cnt;   /* Evicted pages read back in. */
+static long long read_ahead_cnt;  /* ...of them read ahead of a fault. */
+static long long evict_cnt;       /* Frames evicted. */
+static long long evict_dirty_cnt; /* Evicted pages written out. */
+static long long evict_fail_cnt;  /* Evictions that found no victim. */
+static long long scan_cnt;        /* Frames looked at for eviction. */
+static long long scan_max;        /* Most frames looked at at once. */
+static long long cow_share_cnt;   /* Pages shared by fork(). */
+static long long cow_copy_cnt;    /* Shared pages copied on a write. */
+static long long cow_own_cnt;     /* Shared pages left to one owner. */
+static long long zero_map_cnt;    /* Read faults given the zero page. */
+static long long zero_copy_cnt;   /* ...of them written later. */
+static long long around_cnt;      /* Pages mapped around a fault. */
+static long long around_read_cnt; /* ...and the reads that filled them. */
+static long long ra_read_cnt;     /* Readahead reads. */
+static long long ra_page_cnt;     /* Pages mapped by readahead. */
+static long long ra_waste_cnt;    /* Pages read ahead but not used. */
+static long long willneed_cnt;    /* Pages asked for by MADV_WILLNEED. */
+static long long dontneed_cnt;    /* Pages dropped by MADV_DONTNEED. */
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -15,7 +107,19 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	lock_init (&frame_lock);
+#ifndef EFILESYS
+	pagecache_init ();
+#endif
+	page_cache_start ();
+	zero_kva = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	evict_policy->init ();
+	ksm_init ();
+	kswapd_init ();
+	list_init (&ra_queue);
+	sema_init (&ra_sema, 0);
+	if (readahead_max > 0)
+		readahead_start ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -36,10 +140,30 @@ page_get_type (struct page *page) {
 static struct frame *vm_get_victim (void);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static struct page *page_create (struct vm_area *area, void *va,
+		vm_initializer *init, void *aux);
+static struct page *area_get_page (struct vm_area *area, void *va);
+static bool area_init_page (struct page *page, void *aux);
+static void page_free (struct page *page);
+static size_t page_cnt (const struct page *page);
+static bool vm_split_huge_page (struct page *page);
+static bool vm_fault_in (void *addr, void *rsp, bool write, bool pin);
+static void frame_free (struct frame *frame, bool huge);
+static bool page_load (struct page *page, struct frame *frame);
+static bool area_is_cached (const struct vm_area *area, const void *va);
+static bool page_map_frame (struct page *page, struct frame *frame);
+static bool page_map_cache (struct page *page);
+
+/* Returns the page table of the process that PAGE belongs to. */
+static inline uint64_t *
+page_pml4 (const struct page *page) {
+	return page->area->spt->owner->pml4;
+}
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
- * `vm_alloc_page`. */
+ * `vm_alloc_page`.  A page outside every area gets a one-page area of
+ * its own. */
 bool
 vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 		vm_initializer *init, void *aux) {
@@ -47,97 +171,1505 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 	ASSERT (VM_TYPE(type) != VM_UNINIT)
 
 	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_area *area;
+	struct page *page;
 
+	lock_acquire (&frame_lock);
 	/* Check wheter the upage is already occupied or not. */
 	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
+		area = spt_find_area (spt, upage);
+		if (area == NULL)
+			area = spt_add_area (spt, upage, (uint8_t *) upage + PGSIZE, type,
+					writable, NULL, 0, 0);
+		if (area == NULL || VM_TYPE (area->type) != VM_TYPE (type)
+				|| area->writable != writable)
+			goto err;
 
-		/* TODO: Insert the page into the spt. */
+		page = page_create (area, upage, init, aux);
+		if (page == NULL)
+			goto err;
+		if (!spt_insert_page (spt, page)) {
+			vm_dealloc_page (page);
+			goto err;
+		}
+		lock_release (&frame_lock);
+		return true;
 	}
 err:
+	lock_release (&frame_lock);
 	return false;
 }
 
-/* Find VA from spt and return page. On error, return NULL. */
+/* Find VA from spt and return page. On error, return NULL.
+ * A huge page is entered only under its first page. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page *page = radix_lookup (&spt->pages, pg_no (va));
 
+	if (page == NULL) {
+		page = radix_lookup (&spt->pages, pg_no (hpg_round_down (va)));
+		if (page != NULL && !page->huge)
+			page = NULL;
+	}
 	return page;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	ASSERT (pg_ofs (page->va) == 0);
+	ASSERT (page->area != NULL && page->area->spt == spt);
+	ASSERT (lock_held_by_current_thread (&frame_lock));
 
-	return succ;
+	return radix_insert (&spt->pages, pg_no (page->va), page);
 }
 
+/* Removes PAGE from SPT, unmaps it, and frees it. */
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	vm_dealloc_page (page);
+	uint64_t *pml4 = page_pml4 (page);
+
+	lock_acquire (&frame_lock);
+	radix_delete (&spt->pages, pg_no (page->va));
+	if ((page->frame != NULL || page->zero) && pml4 != NULL) {
+		if (page->huge)
+			pml4_clear_huge_page (pml4, page->va);
+		else
+			pml4_clear_page (pml4, page->va);
+	}
+	page_free (page);
+	lock_release (&frame_lock);
+}
+
+/* Returns true if area A starts before area B. */
+static bool
+area_less (const struct rb_node *a_, const struct rb_node *b_,
+		void *aux UNUSED) {
+	const struct vm_area *a = rb_entry (a_, struct vm_area, elem);
+	const struct vm_area *b = rb_entry (b_, struct vm_area, elem);
+
+	return a->start < b->start;
+}
+
+/* Returns the area of SPT that contains VA, or NULL if there is
+ * none. */
+struct vm_area *
+spt_find_area (struct supplemental_page_table *spt, const void *va) {
+	struct vm_area key;
+	struct rb_node *e;
+
+	key.start = (void *) va;
+	e = rb_floor (&spt->areas, &key.elem);
+	if (e != NULL) {
+		struct vm_area *area = rb_entry (e, struct vm_area, elem);
+		if (va < area->end)
+			return area;
+	}
+	return NULL;
+}
+
+/* Adds an area of TYPE from START up to END to SPT, taking over FILE,
+ * which may be NULL.  See struct vm_area for the meaning of the other
+ * arguments.  No pages are allocated.  Returns the new area, or NULL
+ * if the range is not page-aligned user memory, overlaps another
+ * area, or memory is short. */
+struct vm_area *
+spt_add_area (struct supplemental_page_table *spt, void *start, void *end,
+		enum vm_type type, bool writable, struct file *file, off_t offset,
+		size_t read_bytes) {
+	struct vm_area *area, key;
+	struct rb_node *next;
+
+	ASSERT (VM_TYPE (type) == VM_ANON || VM_TYPE (type) == VM_FILE);
+	ASSERT (read_bytes == 0 || file != NULL);
+
+	if (pg_ofs (start) != 0 || pg_ofs (end) != 0 || start >= end
+			|| !is_user_vaddr (start) || !is_user_vaddr ((uint8_t *) end - 1))
+		return NULL;
+
+	/* Refuse to overlap an existing area. */
+	key.start = start;
+	next = rb_upper_bound (&spt->areas, &key.elem);
+	if (spt_find_area (spt, start) != NULL
+			|| (next != NULL && rb_entry (next, struct vm_area, elem)->start < end))
+		return NULL;
+
+	area = malloc (sizeof *area);
+	if (area == NULL)
+		return NULL;
+	area->start = start;
+	area->end = end;
+	area->type = type;
+	area->writable = writable;
+	area->advice = MADV_NORMAL;
+	area->file = file;
+	area->offset = offset;
+	area->read_bytes = read_bytes;
+	area->spt = spt;
+	area->ra_next = 0;
+	area->ra_end = 0;
+	area->ra_window = 0;
+	rb_insert (&spt->areas, &area->elem);
+	if (type & VM_STACK)
+		spt->stack = area;
+	if (VM_TYPE (type) == VM_FILE)
+		file_area_add (area);
+	return area;
+}
+
+/* Removes AREA from SPT: unmaps and frees every page of it that was
+ * faulted in, writing back dirty file-backed pages, and closes its
+ * file.  Untouched pages cost nothing. */
+void
+spt_remove_area (struct supplemental_page_table *spt, struct vm_area *area) {
+	uint64_t *pml4 = spt->owner->pml4;
+	uint64_t first = pg_no (area->start), last = pg_no (area->end) - 1;
+	uint64_t key, run = 0;
+	size_t run_cnt = 0;
+	struct page *page;
+
+	lock_acquire (&frame_lock);
+	readahead_cancel (area);
+
+	/* Unmap the resident pages, a run of neighbors at a time.  Their
+	 * dirty bits stay in the page table for the writeback below. */
+	for (key = first; pml4 != NULL
+			&& (page = radix_next (&spt->pages, &key, last, RADIX_ANY)) != NULL;
+			key++) {
+		if (page->frame == NULL && !page->zero)
+			continue;
+		if (page->huge) {
+			pml4_clear_huge_page (pml4, page->va);
+			continue;
+		}
+		if (run_cnt > 0 && key == run + run_cnt)
+			run_cnt++;
+		else {
+			if (run_cnt > 0)
+				pml4_clear_range (pml4, (void *) (run << PGBITS), run_cnt);
+			run = key;
+			run_cnt = 1;
+		}
+	}
+	if (run_cnt > 0)
+		pml4_clear_range (pml4, (void *) (run << PGBITS), run_cnt);
+	if (VM_TYPE (area->type) == VM_FILE) {
+		file_area_writeback (area, area->start, area->end);
+		file_area_remove (area);
+	}
+
+	for (key = first;
+			(page = radix_next (&spt->pages, &key, last, RADIX_ANY)) != NULL;
+			key++) {
+		radix_delete (&spt->pages, key);
+		page_free (page);
+	}
+	lock_release (&frame_lock);
+
+	rb_remove (&spt->areas, &area->elem);
+	if (spt->stack == area)
+		spt->stack = NULL;
+	if (area->file != NULL) {
+		lock_acquire (&filesys_lock);
+		file_close (area->file);
+		lock_release (&filesys_lock);
+	}
+	free (area);
+}
+
+/* Acquires the frame lock, for the threads that work on the pages of
+ * every process. */
+void
+vm_lock (void) {
+	lock_acquire (&frame_lock);
+}
+
+/* Releases the frame lock. */
+void
+vm_unlock (void) {
+	lock_release (&frame_lock);
+}
+
+/* Returns true if the current thread holds the frame lock. */
+bool
+vm_lock_held (void) {
+	return lock_held_by_current_thread (&frame_lock);
+}
+
+/* FRAME now holds a page: hands it to the replacement policy and to
+ * ksmd. */
+static void
+frame_table_add (struct frame *frame) {
+	evict_policy->add (frame);
+	ksm_add (frame);
+}
+
+/* FRAME's page is going away, or it is being evicted. */
+static void
+frame_table_remove (struct frame *frame) {
+	evict_policy->remove (frame);
+	ksm_remove (frame);
+}
+
+/* Links PAGE to FRAME, which may already have other pages. */
+static void
+frame_link (struct frame *frame, struct page *page) {
+	page->frame = frame;
+	page->share_next = frame->page;
+	frame->page = page;
+	frame->share_cnt++;
+	if (page->locked)
+		frame->lock_cnt++;
+	if (page->area == NULL)
+		frame->cached = true;
+}
+
+/* Unlinks PAGE from FRAME.  PAGE->frame is left for the caller to
+ * change. */
+static void
+frame_unlink (struct frame *frame, struct page *page) {
+	struct page **p;
+
+	for (p = &frame->page; *p != page; p = &(*p)->share_next)
+		ASSERT (*p != NULL);
+	*p = page->share_next;
+	page->share_next = NULL;
+	frame->share_cnt--;
+	if (page->locked)
+		frame->lock_cnt--;
+}
+
+/* Returns true if a mapping of FRAME has been used since its accessed
+ * bits were last cleared.  The kernel's own accesses through KVA do
+ * not count, but read() and write() through the page cache do. */
+bool
+frame_is_accessed (const struct frame *frame) {
+	struct page *p;
+
+	for (p = frame->page; p != NULL; p = p->share_next)
+		if (p->area == NULL ? p->page_cache.accessed
+				: pml4_is_accessed (page_pml4 (p), p->va))
+			return true;
+	return false;
+}
+
+/* Returns true if FRAME must stay resident, because the kernel is
+ * using it or one of its pages is locked. */
+bool
+frame_is_pinned (const struct frame *frame) {
+	return frame->pinned > 0 || frame->lock_cnt > 0;
+}
+
+/* Clears the accessed bits of FRAME's mappings. */
+void
+frame_clear_accessed (struct frame *frame) {
+	struct page *p;
+
+	for (p = frame->page; p != NULL; p = p->share_next)
+		if (p->area == NULL)
+			p->page_cache.accessed = false;
+		else
+			pml4_set_accessed (page_pml4 (p), p->va, false);
+}
+
+/* Returns true if FRAME was written through one of its mappings since
+ * its contents were last saved. */
+bool
+frame_is_dirty (const struct frame *frame) {
+	struct page *p;
+
+	for (p = frame->page; p != NULL; p = p->share_next)
+		if (p->area == NULL ? p->page_cache.dirty
+				: pml4_is_dirty (page_pml4 (p), p->va))
+			return true;
+	return false;
+}
+
+/* Maps PAGE to its frame again, keeping its dirty bit, after it was
+ * unmapped to be evicted.  It is writable only if no other page
+ * shares the frame, or the frame is the page cache's. */
+static void
+page_remap (struct page *page) {
+	uint64_t *pml4 = page_pml4 (page);
+	bool dirty = pml4_is_dirty (pml4, page->va);
+
+	pml4_set_page (pml4, page->va, page->frame->kva, page->area->writable
+			&& (page->frame->share_cnt == 1 || page->frame->cached));
+	pml4_set_dirty (pml4, page->va, dirty);
+}
+
+/* Makes the mappings of FRAME read-only, or, if WRITABLE, puts back
+ * write access where it is due: to a page of a writable area that
+ * does not share the frame.  Accessed and dirty bits are kept. */
+static void
+frame_set_writable (struct frame *frame, bool writable) {
+	struct page *p;
+
+	for (p = frame->page; p != NULL; p = p->share_next)
+		pml4_set_writable (page_pml4 (p), p->va, writable
+				&& p->area->writable && frame->share_cnt == 1);
+}
+
+/* Merges SRC into DST if they hold the same bytes: the pages of SRC
+ * share DST from then on, read-only, as if after a fork(), and SRC is
+ * freed.  Both are write-protected while they are compared, so that a
+ * process that writes to either waits for us.  Returns true if they
+ * were merged. */
+bool
+frame_merge (struct frame *dst, struct frame *src) {
+	struct page *p;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (dst != src);
+
+	frame_set_writable (dst, false);
+	frame_set_writable (src, false);
+	if (memcmp (dst->kva, src->kva, PGSIZE)) {
+		frame_set_writable (dst, true);
+		frame_set_writable (src, true);
+		return false;
+	}
+
+	frame_table_remove (src);
+	while ((p = src->page) != NULL) {
+		uint64_t *pml4 = page_pml4 (p);
+		bool dirty = pml4_is_dirty (pml4, p->va);
+
+		frame_unlink (src, p);
+		frame_link (dst, p);
+		pml4_set_page (pml4, p->va, dst->kva, false);
+		pml4_set_dirty (pml4, p->va, dirty);
+	}
+	frame_free (src, false);
 	return true;
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Get the struct frame, that will be evicted.  The replacement policy
+ * chooses; a huge page that it picks is split first, so that only its
+ * first 4 kB go.  If memory is too short to split it, the policy is
+ * asked for another victim, which it does not pick from the same
+ * place, up to EVICT_TRIES times. */
 static struct frame *
 vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+	long long scanned = 0;
+	struct frame *victim;
+	int tries;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
 
+	for (tries = 0; tries < EVICT_TRIES; tries++) {
+		victim = evict_policy->victim (&scanned);
+		if (victim == NULL || !victim->page->huge
+				|| vm_split_huge_page (victim->page))
+			break;
+		victim = NULL;
+	}
+	scan_cnt += scanned;
+	if (scanned > scan_max)
+		scan_max = scanned;
 	return victim;
 }
 
+/* Evicts the pages that share VICTIM, unmapping them everywhere and
+ * saving them with swap_out().  Returns false, leaving them as they
+ * were, if one of them cannot be saved.  A page of the page cache
+ * leaves the cache along with its frame. */
+static bool
+frame_evict (struct frame *victim) {
+	bool dirty = frame_is_dirty (victim);
+	struct page *p, *next;
+
+	/* Unmap the page, in every process that shares it, before saving
+	 * it, so that they fault and wait for us instead of changing it
+	 * under the write.  Dirty bits survive for swap_out() to see.
+	 * Each sharer saves a copy of its own. */
+	for (p = victim->page; p != NULL; p = p->share_next)
+		if (p->area != NULL)
+			pml4_clear_page (page_pml4 (p), p->va);
+	for (p = victim->page; p != NULL; p = p->share_next)
+		if (!swap_out (p))
+			break;
+	if (p != NULL) {
+		/* Put the mappings back as they were. */
+		for (p = victim->page; p != NULL; p = p->share_next)
+			if (p->area != NULL)
+				page_remap (p);
+		return false;
+	}
+
+	frame_table_remove (victim);
+	for (p = victim->page; p != NULL; p = next) {
+		next = p->share_next;
+		p->frame = NULL;
+		p->share_next = NULL;
+		if (p->area == NULL)
+			vm_dealloc_page (p);
+	}
+	victim->page = NULL;
+	victim->share_cnt = 0;
+	victim->cached = false;
+	evict_cnt++;
+	if (dirty)
+		evict_dirty_cnt++;
+	return true;
+}
+
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Return NULL on error.  When the victim is anonymous, the victims
+ * after it are evicted too as long as they are anonymous, up to
+ * SWAP_CLUSTER in all, so that they go to swap as one run of adjacent
+ * slots; their frames are freed for the faults to come. */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct frame *frame = NULL;
+	bool cluster = false;
+	int fails = 0, cnt = 0;
 
-	return NULL;
+	while (fails < EVICT_TRIES && cnt < SWAP_CLUSTER) {
+		struct frame *victim = vm_get_victim ();
+		bool anon;
+
+		if (victim == NULL)
+			break;
+		anon = VM_TYPE (victim->page->operations->type) == VM_ANON;
+		if (frame != NULL && !anon)
+			break;
+		if (anon && !cluster) {
+			anon_swap_cluster_begin (SWAP_CLUSTER);
+			cluster = true;
+		}
+
+		if (!frame_evict (victim)) {
+			fails++;
+			continue;
+		}
+		if (frame == NULL)
+			frame = victim;
+		else
+			frame_free (victim, false);
+		if (!anon)
+			break;
+		cnt++;
+	}
+	if (cluster)
+		anon_swap_cluster_end ();
+	if (frame == NULL)
+		evict_fail_cnt++;
+	return frame;
+}
+
+/* Returns a new frame for the user page at KVA, or NULL if memory is
+ * short. */
+static struct frame *
+frame_create (void *kva) {
+	struct frame *frame = malloc (sizeof *frame);
+
+	if (frame != NULL) {
+		frame->kva = kva;
+		frame->page = NULL;
+		frame->pinned = 0;
+		frame->share_cnt = 0;
+		frame->lock_cnt = 0;
+		frame->cached = false;
+	}
+	return frame;
+}
+
+/* Returns a new frame from the user pool, without evicting anything,
+ * or NULL if there is none. */
+static struct frame *
+frame_new (void) {
+	struct frame *frame;
+	void *kva = palloc_get_page (PAL_USER);
+
+	if (kva == NULL)
+		return NULL;
+	frame = frame_create (kva);
+	if (frame == NULL)
+		palloc_free_page (kva);
+	return frame;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * and return it.  Returns NULL if no frame can be had.  The frame goes
+ * to the replacement policy once a page is mapped to it. */
 static struct frame *
 vm_get_frame (void) {
-	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	struct frame *frame;
 
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	frame = frame_new ();
+	kswapd_check (frame != NULL);
+	if (frame == NULL)
+		frame = vm_evict_frame ();
 	return frame;
 }
 
-/* Growing the stack. */
+/* Evicts pages until at least CNT frames are freed, or no more can be
+ * evicted, for kswapd.  Returns the number of frames freed. */
+size_t
+vm_reclaim (size_t cnt) {
+	long long start = evict_cnt;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	while ((size_t) (evict_cnt - start) < cnt) {
+		struct frame *frame = vm_evict_frame ();
+
+		if (frame == NULL)
+			break;
+		frame_free (frame, false);
+	}
+	return evict_cnt - start;
+}
+
+/* Frees FRAME, which holds no page, along with its memory, which is a
+ * huge page if HUGE is true. */
 static void
-vm_stack_growth (void *addr UNUSED) {
+frame_free (struct frame *frame, bool huge) {
+	if (huge)
+		palloc_free_huge_page (frame->kva);
+	else
+		palloc_free_page (frame->kva);
+	free (frame);
+}
+
+/* Prints paging statistics, for comparing replacement policies. */
+void
+vm_print_stats (void) {
+	int64_t ticks = timer_ticks ();
+
+	printf ("Paging: %lld faults (%lld per second), %lld pages read back "
+			"(%lld ahead), %lld written out\n", fault_cnt,
+			ticks > 0 ? fault_cnt * TIMER_FREQ / ticks : 0,
+			read_back_cnt, read_ahead_cnt, evict_dirty_cnt);
+	printf ("Eviction (%s): %lld frames evicted, %lld failed, "
+			"%lld looked at, %lld per eviction, %lld at most\n",
+			evict_policy->name, evict_cnt, evict_fail_cnt, scan_cnt,
+			evict_cnt > 0 ? scan_cnt / evict_cnt : 0, scan_max);
+	printf ("Copy-on-write: %lld pages shared, %lld copied, %lld kept\n",
+			cow_share_cnt, cow_copy_cnt, cow_own_cnt);
+	printf ("Zero page: %lld pages mapped, %lld written later\n",
+			zero_map_cnt, zero_copy_cnt);
+	printf ("Fault-around: %lld pages mapped in %lld reads\n",
+			around_cnt, around_read_cnt);
+	printf ("Readahead: %lld pages mapped in %lld reads, %lld not used\n",
+			ra_page_cnt, ra_read_cnt, ra_waste_cnt);
+	printf ("Advice: %lld pages asked for, %lld dropped\n",
+			willneed_cnt, dontneed_cnt);
+	ksm_print_stats ();
+	kswapd_print_stats ();
+	page_cache_print_stats ();
+	file_print_stats ();
+	anon_print_stats ();
+}
+
+/* Returns true if a fault at ADDR, with the user's stack pointer at
+ * RSP, is a push or a reference just below the stack that should
+ * grow it.  Like PUSH, such an access may be at most 8 bytes below
+ * RSP. */
+static bool
+stack_may_grow (struct supplemental_page_table *spt, const void *addr,
+		const void *rsp) {
+	return spt->stack != NULL
+		&& (uint8_t *) addr >= (uint8_t *) USER_STACK - STACK_MAX
+		&& addr < spt->stack->start
+		&& (uint8_t *) addr >= (uint8_t *) rsp - 8;
 }
 
-/* Handle the fault on write_protected page */
+/* Growing the stack.  Extends the stack's area down to the page of
+ * ADDR, unless that would run into the area below it.  The pages
+ * themselves are faulted in one by one. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_stack_growth (void *addr) {
+	struct vm_area *stack = thread_current ()->spt.stack;
+	struct rb_node *prev = rb_prev (&stack->elem);
+	void *start = pg_round_down (addr);
+
+	if (prev != NULL && rb_entry (prev, struct vm_area, elem)->end > start)
+		return false;
+
+	/* No area lies in between, so the tree stays ordered. */
+	stack->start = start;
+	return true;
+}
+
+/* Handle the fault on write_protected page.  PAGE is writable but
+ * shares its frame copy-on-write since a fork(), so it gets a copy of
+ * its own, unless the other sharers are gone and it can simply have
+ * the frame.  A page mapped to the zero page gets a zeroed frame. */
+static bool
+vm_handle_wp (struct page *page) {
+	struct frame *old = page->frame, *new;
+	uint64_t *pml4 = page_pml4 (page);
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (page->zero && page->area->writable) {
+		if (!vm_do_claim_page (page))
+			return false;
+		zero_copy_cnt++;
+		return true;
+	}
+	if (!page->area->writable || old == NULL)
+		return false;
+	if (old->cached) {
+		/* The page cache's frames are shared, not copied. */
+		pml4_set_writable (pml4, page->va, true);
+		return true;
+	}
+	ksm_write_fault (old);
+	if (old->share_cnt == 1) {
+		pml4_set_writable (pml4, page->va, true);
+		cow_own_cnt++;
+		return true;
+	}
+
+	/* Keep the frame we copy from while finding one to copy to. */
+	old->pinned++;
+	new = vm_get_frame ();
+	old->pinned--;
+	if (new == NULL)
+		return false;
+
+	memcpy (new->kva, old->kva, PGSIZE);
+	frame_unlink (old, page);
+	frame_link (new, page);
+	pml4_set_page (pml4, page->va, new->kva, true);
+	frame_table_add (new);
+	cow_copy_cnt++;
+	return true;
+}
+
+/* Tries to back the whole 2 MB block around ADDR in AREA with one
+ * huge page.  That takes an anonymous, zero-filled part of an area
+ * that covers the block, with none of the block's pages faulted in
+ * yet.  Returns true if the block is now mapped. */
+static bool
+vm_alloc_huge_page (struct vm_area *area, void *addr) {
+	struct supplemental_page_table *spt = area->spt;
+	uint8_t *start = hpg_round_down (addr);
+	uint64_t key = pg_no (start);
+	struct page *page = NULL;
+	struct frame *frame = NULL;
+	void *kva;
+
+	if (VM_TYPE (area->type) != VM_ANON || (area->type & VM_STACK)
+			|| start < (uint8_t *) area->start
+			|| start + HPGSIZE > (uint8_t *) area->end
+			|| start < (uint8_t *) area->start + area->read_bytes
+			|| radix_next (&spt->pages, &key,
+				pg_no (start + HPGSIZE) - 1, RADIX_ANY) != NULL)
+		return false;
+
+	kva = palloc_get_huge_page (PAL_USER | PAL_ZERO);
+	if (kva == NULL)
+		return false;
+	page = malloc (sizeof *page);
+	frame = malloc (sizeof *frame);
+	if (page == NULL || frame == NULL)
+		goto fail;
+
+	*page = (struct page) { .va = start, .frame = frame, .area = area,
+		.huge = true };
+	anon_initializer (page, area->type, kva);
+	frame->kva = kva;
+	frame->page = page;
+	frame->pinned = 0;
+	frame->share_cnt = 1;
+	frame->lock_cnt = 0;
+	frame->cached = false;
+	if (!spt_insert_page (spt, page))
+		goto fail;
+	if (!pml4_set_huge_page (spt->owner->pml4, start, kva, area->writable)) {
+		radix_delete (&spt->pages, pg_no (start));
+		goto fail;
+	}
+	frame_table_add (frame);
+	return true;
+
+fail:
+	free (page);
+	free (frame);
+	palloc_free_huge_page (kva);
+	return false;
+}
+
+/* Splits huge PAGE into 512 pages of 4 kB over the same memory, so
+ * that they can be copied, shared, or evicted one at a time.  PAGE
+ * itself becomes the first of them.  Returns false, leaving PAGE as
+ * it was, if memory is short. */
+static bool
+vm_split_huge_page (struct page *page) {
+	struct supplemental_page_table *spt = page->area->spt;
+	const size_t cnt = HPGSIZE / PGSIZE;
+	uint64_t key = pg_no (page->va);
+	size_t i;
+
+	ASSERT (page->huge);
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (i = 1; i < cnt; i++) {
+		struct page *sub = malloc (sizeof *sub);
+		struct frame *frame = malloc (sizeof *frame);
+		void *kva = (uint8_t *) page->frame->kva + i * PGSIZE;
+
+		if (sub == NULL || frame == NULL
+				|| !radix_insert (&spt->pages, key + i, sub)) {
+			free (sub);
+			free (frame);
+			goto fail;
+		}
+		*sub = (struct page) { .va = (uint8_t *) page->va + i * PGSIZE,
+			.frame = frame, .area = page->area, .locked = page->locked };
+		anon_initializer (sub, page->area->type, kva);
+		frame->kva = kva;
+		frame->page = sub;
+		frame->pinned = 0;
+		frame->share_cnt = 1;
+		frame->lock_cnt = sub->locked ? 1 : 0;
+		frame->cached = false;
+		frame_table_add (frame);
+	}
+	if (!pml4_split_huge_page (page_pml4 (page), page->va))
+		goto fail;
+	page->huge = false;
+	return true;
+
+fail:
+	while (--i > 0) {
+		struct page *sub = radix_delete (&spt->pages, key + i);
+		frame_table_remove (sub->frame);
+		free (sub->frame);
+		free (sub);
+	}
+	return false;
+}
+
+/* Maps page VA of AREA to the zero page, if it has not been faulted
+ * in before and would start out all zeros: it lies in an anonymous
+ * area, other than the stack, past the part read from a file.
+ * Returns true if it did. */
+static bool
+vm_map_zero_page (struct vm_area *area, void *va) {
+	size_t ofs = (uint8_t *) va - (uint8_t *) area->start;
+	struct page *page;
+
+	if (VM_TYPE (area->type) != VM_ANON || (area->type & VM_STACK)
+			|| ofs < area->read_bytes)
+		return false;
+	page = area_get_page (area, va);
+	if (page == NULL || page->frame != NULL || page->zero
+			|| VM_TYPE (page->operations->type) != VM_UNINIT
+			|| page->uninit.init != area_init_page
+			|| !pml4_set_page (page_pml4 (page), va, zero_kva, false))
+		return false;
+	page->zero = true;
+	zero_map_cnt++;
+	return true;
+}
+
+/* Gives the CNT pages of AREA from page FIRST on the CNT adjacent user
+ * pages at KVA, which hold their contents, and maps them.  A page
+ * that has been faulted in meanwhile keeps its own frame, and a page
+ * of the page cache that is cached already is mapped to the cached
+ * frame.  They are mapped with their accessed bits clear, so that
+ * they are the first to go if they are never used.  Every page at KVA
+ * is used or freed.  Returns the number of pages mapped. */
+static size_t
+area_install_pages (struct vm_area *area, size_t first, size_t cnt,
+		uint8_t *kva) {
+	uint8_t *va = (uint8_t *) area->start + first * PGSIZE;
+	size_t i, installed = 0;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (i = 0; i < cnt; i++) {
+		uint8_t *upage = va + i * PGSIZE, *page_kva = kva + i * PGSIZE;
+		struct page *page;
+		struct frame *frame;
+		bool success;
+
+		if (spt_find_page (area->spt, upage) != NULL) {
+			palloc_free_page (page_kva);
+			continue;
+		}
+
+		/* The contents are in already, so the page has no initializer. */
+		page = page_create (area, upage, NULL, NULL);
+		if (page == NULL || !spt_insert_page (area->spt, page)) {
+			if (page != NULL)
+				vm_dealloc_page (page);
+			palloc_free_multiple (page_kva, cnt - i);
+			break;
+		}
+		if (area_is_cached (area, upage)) {
+			frame = page_cache_install (file_get_inode (area->file),
+					area->offset + (upage - (uint8_t *) area->start), page_kva);
+			success = frame != NULL && page_map_frame (page, frame);
+		} else {
+			frame = frame_create (page_kva);
+			success = frame != NULL && page_load (page, frame);
+			if (frame != NULL && !success)
+				frame_free (frame, false);
+			else if (frame == NULL)
+				palloc_free_page (page_kva);
+		}
+		if (!success) {
+			radix_delete (&area->spt->pages, pg_no (page->va));
+			vm_dealloc_page (page);
+			palloc_free_multiple (page_kva + PGSIZE, cnt - i - 1);
+			break;
+		}
+		installed++;
+	}
+	return installed;
+}
+
+/* Reads the CNT pages of AREA from page FIRST on, all of which lie in
+ * the part of AREA read from its file, from FILE into CNT adjacent
+ * user pages, with one read.  Pages that are to go into the page
+ * cache are read whole, up to the end of the file, straight from the
+ * disk; the others are read through the cache.  Returns those pages,
+ * or NULL if memory is short or FILE cannot be read. */
+static uint8_t *
+area_read_pages (struct vm_area *area, struct file *file, size_t first,
+		size_t cnt) {
+	size_t ofs = first * PGSIZE;
+	size_t bytes = area->read_bytes - ofs;
+	bool cached = area_is_cached (area, (uint8_t *) area->start + ofs);
+	uint8_t *kva;
+	off_t read;
+
+	ASSERT (ofs < area->read_bytes);
+
+	if (cached)
+		bytes = file_length (file) - (area->offset + ofs);
+	if (bytes > cnt * PGSIZE)
+		bytes = cnt * PGSIZE;
+	kva = palloc_get_multiple (PAL_USER, cnt);
+	if (kva == NULL)
+		return NULL;
+	read = cached
+		? page_cache_read_direct (file_get_inode (file), kva, bytes,
+			area->offset + ofs)
+		: vm_file_read_at (file, kva, bytes, area->offset + ofs);
+	if (read != (off_t) bytes) {
+		palloc_free_multiple (kva, cnt);
+		return NULL;
+	}
+	memset (kva + bytes, 0, cnt * PGSIZE - bytes);
+
+	/* The last page of a run of text may be a private page, which is
+	 * zeroed past the end of the segment. */
+	if (cached && ofs + cnt * PGSIZE > area->read_bytes
+			&& !area_is_cached (area,
+				(uint8_t *) area->start + ofs + (cnt - 1) * PGSIZE))
+		memset (kva + (area->read_bytes - ofs), 0,
+				ofs + cnt * PGSIZE - area->read_bytes);
+	return kva;
+}
+
+/* Faults in the CNT pages of AREA from page FIRST on, which have never
+ * been touched and all lie in the part of AREA read from its file.
+ * Returns false if memory is short, or the file cannot be read, which
+ * leaves some or all of them alone. */
+static bool
+fault_around_run (struct vm_area *area, size_t first, size_t cnt) {
+	uint8_t *kva = area_read_pages (area, area->file, first, cnt);
+	size_t installed;
+
+	if (kva == NULL)
+		return false;
+	around_read_cnt++;
+	installed = area_install_pages (area, first, cnt, kva);
+	around_cnt += installed;
+	return installed == cnt;
+}
+
+/* Maps page IDX of AREA, which has never been touched, to its page of
+ * the page cache if that is cached already, which takes no read.
+ * Returns true if it did. */
+static bool
+area_map_cached (struct vm_area *area, size_t idx) {
+	uint8_t *va = (uint8_t *) area->start + idx * PGSIZE;
+	struct frame *frame;
+	struct page *page;
+
+	if (!area_is_cached (area, va))
+		return false;
+	frame = page_cache_lookup (file_get_inode (area->file),
+			area->offset + idx * PGSIZE);
+	if (frame == NULL)
+		return false;
+	page = area_get_page (area, va);
+	return page != NULL && page_map_frame (page, frame);
+}
+
+/* PAGE has just been read in from its area's file.  Faults in the
+ * other pages of the window of fault_around_pages pages around it,
+ * aligned to that size within the area, that are also read from the
+ * file and have never been touched, since a program that reads one
+ * part of a file or executable will likely read the parts nearby.
+ * Those in the page cache are mapped from it; the others are read in
+ * runs. */
+static void
+vm_fault_around (struct page *page) {
+	struct vm_area *area = page->area;
+	size_t idx = pg_no (page->va) - pg_no (area->start);
+	size_t file_pages = DIV_ROUND_UP (area->read_bytes, PGSIZE);
+	size_t n = fault_around_pages, first, last, i;
+
+	if (n < 2 || idx >= file_pages)
+		return;
+	first = idx / n * n;
+	last = first + n < file_pages ? first + n : file_pages;
+
+	for (i = first; i < last; ) {
+		size_t cnt = 0;
+
+		while (i + cnt < last && i + cnt != idx
+				&& spt_find_page (area->spt,
+					(uint8_t *) area->start + (i + cnt) * PGSIZE) == NULL) {
+			if (area_map_cached (area, i + cnt)) {
+				around_cnt++;
+				break;
+			}
+			cnt++;
+		}
+		if (cnt == 0)
+			i++;
+		else if (!fault_around_run (area, i, cnt))
+			return;
+		else
+			i += cnt;
+	}
+}
+
+/* Returns the most pages of AREA to read ahead at once, which depends
+ * on what madvise() has said about it. */
+static size_t
+area_readahead_max (const struct vm_area *area) {
+	if (area->advice == MADV_RANDOM)
+		return 0;
+	if (area->advice == MADV_SEQUENTIAL && readahead_max < RA_SEQ_WINDOW)
+		return RA_SEQ_WINDOW;
+	return readahead_max;
+}
+
+/* Asks for the CNT pages of AREA from page FIRST on, which lie in the
+ * part read from its file, to be read in the background.  Returns
+ * false if memory is short. */
+static bool
+readahead_queue (struct vm_area *area, size_t first, size_t cnt) {
+	struct readahead *ra = malloc (sizeof *ra);
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (ra == NULL)
+		return false;
+	ra->area = area;
+	ra->first = first;
+	ra->cnt = cnt;
+	list_push_back (&ra_queue, &ra->elem);
+	sema_up (&ra_sema);
+	return true;
+}
+
+/* Clears the accessed bits of the resident pages of AREA from page
+ * FIRST up to page LAST, which a sequential reader has gone past, so
+ * that they are the first to be evicted. */
+static void
+area_drop_behind (struct vm_area *area, size_t first, size_t last) {
+	size_t i;
+
+	for (i = first; i < last; i++) {
+		struct page *page = spt_find_page (area->spt,
+				(uint8_t *) area->start + i * PGSIZE);
+
+		if (page != NULL && page->frame != NULL && !page->huge)
+			pml4_set_accessed (page_pml4 (page), page->va, false);
+	}
+}
+
+/* PAGE has just been read in from its area's file.  If the faults on
+ * the area are sequential, which they are if each one is on the page
+ * after the last or past the pages already read ahead, asks for the
+ * next window of pages to be read in the background, so that they are
+ * in by the time they are needed.  The window doubles while faults
+ * stay sequential and goes back to nothing on the first one that is
+ * not.  In an area advised to be MADV_SEQUENTIAL every fault counts
+ * as sequential, the window is the largest from the start, and the
+ * pages behind the fault are dropped first. */
+static void
+vm_readahead (struct page *page) {
+	struct vm_area *area = page->area;
+	size_t idx = pg_no (page->va) - pg_no (area->start);
+	size_t file_pages = DIV_ROUND_UP (area->read_bytes, PGSIZE);
+	size_t max = area_readahead_max (area);
+	size_t first, end;
+
+	if (max == 0 || idx >= file_pages)
+		return;
+	if (area->advice == MADV_SEQUENTIAL) {
+		first = area->ra_next > 0 ? area->ra_next - 1 : 0;
+		if (idx > first + max)
+			first = idx - max;
+		area_drop_behind (area, first, idx);
+		if (idx + 1 < area->ra_next || idx > area->ra_end)
+			area->ra_end = idx + 1;
+		area->ra_window = max;
+	} else if (idx < area->ra_next || idx > area->ra_end) {
+		area->ra_window = 0;
+		area->ra_next = area->ra_end = idx + 1;
+		return;
+	} else if (area->ra_window == 0)
+		area->ra_window = RA_MIN_WINDOW;
+	else
+		area->ra_window *= 2;
+	if (area->ra_window > max)
+		area->ra_window = max;
+	area->ra_next = idx + 1;
+
+	first = area->ra_end > idx + 1 ? area->ra_end : idx + 1;
+	end = idx + 1 + area->ra_window;
+	if (end > file_pages)
+		end = file_pages;
+	if (first >= end || !readahead_queue (area, first, end - first))
+		return;
+	area->ra_end = end;
+}
+
+/* Starts the readahead thread, unless it is running already. */
+static void
+readahead_start (void) {
+	if (ra_started)
+		return;
+	if (thread_create ("readahead", PRI_DEFAULT, readahead_daemon, NULL)
+			== TID_ERROR)
+		PANIC ("cannot start readahead thread");
+	ra_started = true;
+}
+
+/* Drops the readahead requests for AREA, which is going away. */
+static void
+readahead_cancel (struct vm_area *area) {
+	struct list_elem *e;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	for (e = list_begin (&ra_queue); e != list_end (&ra_queue); ) {
+		struct readahead *ra = list_entry (e, struct readahead, elem);
+
+		e = list_next (e);
+		if (ra->area == area) {
+			list_remove (&ra->elem);
+			free (ra);
+		}
+	}
+	if (ra_current != NULL && ra_current->area == area)
+		ra_current->area = NULL;
+}
+
+/* The readahead thread.  Reads the pages of each request without
+ * holding the frame lock, from a file of its own, so that faults go on
+ * meanwhile, then maps those that nobody has faulted in since. */
+static void
+readahead_daemon (void *aux UNUSED) {
+	for (;;) {
+		struct readahead *ra;
+		struct vm_area area;
+		struct file *file;
+		uint8_t *kva = NULL;
+		uint64_t epoch;
+
+		sema_down (&ra_sema);
+		lock_acquire (&frame_lock);
+		if (list_empty (&ra_queue)) {
+			lock_release (&frame_lock);
+			continue;
+		}
+		ra = list_entry (list_pop_front (&ra_queue), struct readahead, elem);
+		ra_current = ra;
+		area = *ra->area;
+		epoch = page_cache_epoch ();
+		lock_acquire (&filesys_lock);
+		file = file_reopen (area.file);
+		lock_release (&filesys_lock);
+		lock_release (&frame_lock);
+
+		if (file != NULL) {
+			kva = area_read_pages (&area, file, ra->first, ra->cnt);
+			lock_acquire (&filesys_lock);
+			file_close (file);
+			lock_release (&filesys_lock);
+		}
+
+		lock_acquire (&frame_lock);
+		ra_current = NULL;
+
+		/* The area may have been removed meanwhile, and pages for the
+		 * page cache were read from the disk, which may have been
+		 * written meanwhile by pages that have left the cache since. */
+		if (kva != NULL && (ra->area == NULL
+				|| (page_cache_epoch () != epoch
+					&& area_is_cached (ra->area, (uint8_t *) ra->area->start
+						+ ra->first * PGSIZE)))) {
+			palloc_free_multiple (kva, ra->cnt);
+			ra_waste_cnt += ra->cnt;
+			kva = NULL;
+		}
+		if (kva != NULL) {
+			size_t installed;
+
+			ra_read_cnt++;
+			installed = area_install_pages (ra->area, ra->first, ra->cnt, kva);
+			ra_page_cnt += installed;
+			ra_waste_cnt += ra->cnt - installed;
+		}
+		lock_release (&frame_lock);
+		free (ra);
+	}
+}
+
+/* Makes the page at user address ADDR resident, as a not-present
+ * fault there would, growing the stack down to it if that is what a
+ * reference with the user's stack pointer at RSP calls for.  A read
+ * may be given the zero page, unless PIN says the page is to be
+ * pinned, which takes a frame of its own.  Returns false if ADDR is
+ * not in the address space, or is read-only and WRITE is true, or
+ * memory is short. */
+static bool
+vm_fault_in (void *addr, void *rsp, bool write, bool pin) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vm_area *area;
+	struct page *page;
+	bool fresh;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	area = spt_find_area (spt, addr);
+	if (area == NULL) {
+		if (!stack_may_grow (spt, addr, rsp) || !vm_stack_growth (addr))
+			return false;
+		area = spt->stack;
+	}
+	if (write && !area->writable)
+		return false;
+
+	if (vm_alloc_huge_page (area, addr))
+		return true;
+	if (!write && !pin && vm_map_zero_page (area, pg_round_down (addr)))
+		return true;
+	page = area_get_page (area, pg_round_down (addr));
+	if (page == NULL)
+		return false;
+	fresh = page->frame == NULL
+		&& VM_TYPE (page->operations->type) == VM_UNINIT;
+	if (!vm_do_claim_page (page))
+		return false;
+	if (fresh && !pin && area->file != NULL && area->advice != MADV_RANDOM) {
+		vm_fault_around (page);
+		vm_readahead (page);
+	}
+
+	/* The kernel's own writes ignore read-only mappings, so a shared
+	 * page that it is about to write has to be copied up front. */
+	return !write || page->frame->share_cnt == 1 || vm_handle_wp (page);
 }
 
 /* Return true on success */
 bool
-vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
-		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
-	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+vm_try_handle_fault (struct intr_frame *f, void *addr,
+		bool user, bool write, bool not_present) {
+	struct thread *t = thread_current ();
+	struct page *page;
+	bool success;
 
-	return vm_do_claim_page (page);
+	/* Validate the fault */
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	lock_acquire (&frame_lock);
+	fault_cnt++;
+	if (!not_present) {
+		page = spt_find_page (&t->spt, addr);
+		success = page != NULL && write && vm_handle_wp (page);
+	} else {
+		/* The kernel touches user memory only in system calls, so the
+		 * user's stack pointer is the one saved on entry. */
+		void *rsp = user ? (void *) f->rsp : t->user_rsp;
+
+		success = vm_fault_in (addr, rsp, write, false);
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Faults in the pages that the SIZE bytes at user address BUFFER span,
+ * for writing if WRITE is true, and pins them so that they stay
+ * resident until vm_unpin_buffer().  System calls pin the buffers they
+ * pass to the file system, which must not fault while holding its
+ * lock.  Returns false, pinning nothing, if a page cannot be had. */
+bool
+vm_pin_buffer (const void *buffer, size_t size, bool write) {
+	struct thread *t = thread_current ();
+	uint8_t *start = pg_round_down (buffer);
+	uint8_t *end = (uint8_t *) buffer + size;
+	uint8_t *upage;
+
+	lock_acquire (&frame_lock);
+	for (upage = start; size > 0 && upage < end; upage += PGSIZE) {
+		struct page *page;
+
+		if (!vm_fault_in (upage, t->user_rsp, write, true)
+				|| (page = spt_find_page (&t->spt, upage)) == NULL) {
+			lock_release (&frame_lock);
+			vm_unpin_buffer (start, upage - start);
+			return false;
+		}
+		page->frame->pinned++;
+
+		/* The kernel writes through its own mapping of the frame, which
+		 * leaves the dirty bit of the user's alone. */
+		if (write)
+			pml4_set_dirty (t->pml4, upage, true);
+	}
+	lock_release (&frame_lock);
+	return true;
+}
+
+/* Unpins the pages that the SIZE bytes at user address BUFFER span,
+ * which vm_pin_buffer() pinned. */
+void
+vm_unpin_buffer (const void *buffer, size_t size) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *end = (uint8_t *) buffer + size;
+	uint8_t *upage;
+
+	lock_acquire (&frame_lock);
+	for (upage = pg_round_down (buffer); size > 0 && upage < end;
+			upage += PGSIZE) {
+		struct page *page = spt_find_page (spt, upage);
+
+		if (page != NULL && page->frame != NULL) {
+			ASSERT (page->frame->pinned > 0);
+			page->frame->pinned--;
+		}
+	}
+	lock_release (&frame_lock);
+}
+
+/* Returns true if the current process may access user address
+ * UADDR, for writing if WRITE is true, because it lies in one of its
+ * areas or just below the stack.  The page need not be resident. */
+bool
+vm_access_ok (const void *uaddr, bool write) {
+	struct thread *t = thread_current ();
+	struct vm_area *area;
+
+	if (uaddr == NULL || !is_user_vaddr (uaddr))
+		return false;
+	area = spt_find_area (&t->spt, uaddr);
+	if (area == NULL)
+		return stack_may_grow (&t->spt, uaddr, t->user_rsp);
+	return !write || area->writable;
+}
+
+/* Returns true if every page from START up to END lies in one of the
+ * areas of SPT. */
+static bool
+spt_range_mapped (struct supplemental_page_table *spt, uint8_t *start,
+		uint8_t *end) {
+	while (start < end) {
+		struct vm_area *area = spt_find_area (spt, start);
+
+		if (area == NULL)
+			return false;
+		start = area->end;
+	}
+	return true;
+}
+
+/* Reads in the pages of AREA from START up to END ahead of their use.
+ * Pages that were evicted are read back now, into free frames only,
+ * and pages never touched are read from the area's file in the
+ * background, RA_SEQ_WINDOW at a time.  Pages that would start out
+ * zero-filled are left alone. */
+static void
+area_willneed (struct vm_area *area, uint8_t *start, uint8_t *end) {
+	size_t file_pages = DIV_ROUND_UP (area->read_bytes, PGSIZE);
+	size_t last = pg_no (end) - pg_no (area->start);
+	size_t i, run = 0, run_cnt = 0;
+
+	for (i = pg_no (start) - pg_no (area->start); i <= last; i++) {
+		struct page *page = NULL;
+		struct frame *frame;
+		bool untouched = false;
+
+		if (i < last) {
+			page = spt_find_page (area->spt,
+					(uint8_t *) area->start + i * PGSIZE);
+			untouched = page == NULL && i < file_pages;
+		}
+		if (run_cnt > 0 && (!untouched || run_cnt == RA_SEQ_WINDOW)) {
+			if (readahead_queue (area, run, run_cnt))
+				willneed_cnt += run_cnt;
+			run_cnt = 0;
+		}
+
+		if (untouched) {
+			if (run_cnt++ == 0)
+				run = i;
+		} else if (page != NULL && page->frame == NULL && !page->zero
+				&& VM_TYPE (page->operations->type) != VM_UNINIT
+				&& area_is_cached (area, page->va)) {
+			if (page_map_cache (page))
+				willneed_cnt++;
+		} else if (page != NULL && page->frame == NULL && !page->zero
+				&& VM_TYPE (page->operations->type) != VM_UNINIT
+				&& (frame = frame_new ()) != NULL) {
+			if (!page_load (page, frame)) {
+				frame_free (frame, false);
+				continue;
+			}
+			read_back_cnt++;
+			willneed_cnt++;
+		}
+	}
+}
+
+/* Drops the pages of AREA from START up to END without saving them
+ * anywhere, since the process no longer needs what they hold.  A page
+ * that is touched again starts out afresh, read from the area's file
+ * or zero-filled.  The pages of a file mapping are pages of the page
+ * cache, though, which others may share, so changes to them stay and
+ * are written back.  Locked pages and pages the kernel is using
+ * stay. */
+static void
+area_dontneed (struct vm_area *area, uint8_t *start, uint8_t *end) {
+	struct supplemental_page_table *spt = area->spt;
+	uint64_t key = pg_no (start), last = pg_no (end) - 1;
+	struct page *page;
+
+	/* Only the part of a huge page inside the range goes. */
+	page = spt_find_page (spt, start);
+	if (page != NULL && page->huge && page->va != start && !page->locked)
+		vm_split_huge_page (page);
+
+	for (; (page = radix_next (&spt->pages, &key, last, RADIX_ANY)) != NULL;
+			key++) {
+		uint64_t *pml4 = page_pml4 (page);
+
+		if (page->locked
+				|| (page->frame != NULL && page->frame->pinned > 0))
+			continue;
+		if (page->huge && !vm_split_huge_page (page))
+			continue;
+
+		/* A clean page is not written back when it is freed. */
+		if ((page->frame != NULL || page->zero) && pml4 != NULL) {
+			if (page->frame == NULL || !page->frame->cached)
+				pml4_set_dirty (pml4, page->va, false);
+			pml4_clear_page (pml4, page->va);
+		}
+		radix_delete (&spt->pages, key);
+		page_free (page);
+		dontneed_cnt++;
+	}
+}
+
+/* Applies ADVICE, one of the MADV_* values, to the LENGTH bytes at
+ * ADDR, which must be page-aligned and lie in the areas of the current
+ * process.  MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL are taken by
+ * each area that the range touches, as a whole, and steer
+ * fault-around, readahead and eviction from then on; MADV_WILLNEED
+ * and MADV_DONTNEED act on the pages in the range right away.
+ * Returns false if the arguments are bad. */
+bool
+vm_madvise (void *addr, size_t length, int advice) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	uint8_t *start = addr, *end = start + length;
+	bool success;
+
+	if (pg_ofs (addr) != 0 || end < start
+			|| advice < MADV_NORMAL || advice > MADV_DONTNEED)
+		return false;
+	end = pg_round_up (end);
+
+	lock_acquire (&frame_lock);
+	success = spt_range_mapped (spt, start, end);
+	if (success && (advice == MADV_SEQUENTIAL || advice == MADV_WILLNEED))
+		readahead_start ();
+	while (success && start < end) {
+		struct vm_area *area = spt_find_area (spt, start);
+		uint8_t *stop = end < (uint8_t *) area->end ? end : area->end;
+
+		if (advice == MADV_WILLNEED)
+			area_willneed (area, start, stop);
+		else if (advice == MADV_DONTNEED)
+			area_dontneed (area, start, stop);
+		else {
+			area->advice = advice;
+			area->ra_window = 0;
+		}
+		start = stop;
+	}
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Locks the pages that the LENGTH bytes at user address ADDR span, if
+ * LOCK is true, faulting them in first, or unlocks them.  A locked
+ * page stays resident, and keeps its contents through MADV_DONTNEED,
+ * until it is unlocked or unmapped; the replacement policies pass
+ * over its frame.  Locking too much would leave too little to evict,
+ * so a process may lock no more than 1/MLOCK_LIMIT_DIV of the user
+ * pool.  Returns false if the range does not lie in the areas of the
+ * current process, the limit is reached, or memory is short, in which
+ * case some of its pages may be locked. */
+bool
+vm_mlock (void *addr, size_t length, bool lock) {
+	struct thread *t = thread_current ();
+	size_t limit = palloc_user_cnt () / MLOCK_LIMIT_DIV;
+	uint8_t *start = pg_round_down (addr);
+	uint8_t *end = (uint8_t *) addr + length;
+	uint8_t *upage;
+	bool success;
+
+	if (length == 0)
+		return true;
+	if (end < (uint8_t *) addr)
+		return false;
+
+	lock_acquire (&frame_lock);
+	success = spt_range_mapped (&t->spt, start, end);
+	for (upage = start; success && upage < end; upage += PGSIZE) {
+		struct page *page;
+
+		if (lock && !vm_fault_in (upage, t->user_rsp, false, true)) {
+			success = false;
+			break;
+		}
+		page = spt_find_page (&t->spt, upage);
+		if (page == NULL || page->locked == lock)
+			continue;
+		if (lock && t->spt.locked_cnt + page_cnt (page) > limit) {
+			success = false;
+			break;
+		}
+
+		/* A locked page is always resident. */
+		page->locked = lock;
+		page->frame->lock_cnt += lock ? 1 : -1;
+		if (lock)
+			t->spt.locked_cnt += page_cnt (page);
+		else
+			t->spt.locked_cnt -= page_cnt (page);
+	}
+	lock_release (&frame_lock);
+	return success;
 }
 
 /* Free the page.
@@ -148,43 +1680,481 @@ vm_dealloc_page (struct page *page) {
 	free (page);
 }
 
+/* Returns the number of 4 kB pages that PAGE maps. */
+static size_t
+page_cnt (const struct page *page) {
+	return page->huge ? HPGSIZE / PGSIZE : 1;
+}
+
+/* Frees PAGE, which must already be unmapped, and its frame unless
+ * other pages still share it. */
+static void
+page_free (struct page *page) {
+	struct frame *frame = page->frame;
+	bool huge = page->huge;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (page->locked)
+		page->area->spt->locked_cnt -= page_cnt (page);
+	if (frame != NULL) {
+		if (frame->share_cnt == 1)
+			frame_table_remove (frame);
+		frame_unlink (frame, page);
+	}
+	vm_dealloc_page (page);
+	if (frame != NULL && frame->share_cnt == 0)
+		frame_free (frame, huge);
+}
+
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct vm_area *area = spt_find_area (&thread_current ()->spt, va);
+	struct page *page;
+	bool success;
+
+	if (area == NULL)
+		return false;
+	lock_acquire (&frame_lock);
+	page = area_get_page (area, pg_round_down (va));
+	success = page != NULL && vm_do_claim_page (page);
+	lock_release (&frame_lock);
+	return success;
+}
+
+/* Links PAGE to FRAME, which is free, fills the frame, and maps PAGE
+ * to it, in place of the zero page if that is where it was mapped.
+ * On failure FRAME is left free. */
+static bool
+page_load (struct page *page, struct frame *frame) {
+	/* Set links */
+	frame_link (frame, page);
 
-	return vm_do_claim_page (page);
+	/* Fill the frame, then map the page's VA to it.  A page of the page
+	 * cache is mapped by the pages that share it instead. */
+	if (!swap_in (page, frame->kva)
+			|| (page->area != NULL
+				&& !pml4_set_page (page_pml4 (page), page->va, frame->kva,
+					page->area->writable))) {
+		frame_unlink (frame, page);
+		page->frame = NULL;
+		return false;
+	}
+	page->zero = false;
+	frame_table_add (frame);
+	return true;
+}
+
+/* Reads back the neighbors of PAGE, just read from swap slot SLOT,
+ * that went to swap in the same run of slots: the pages just before
+ * and after PAGE whose slots are just before and after SLOT.  Pages
+ * evicted together tend to be needed together.  Only free frames are
+ * used; nothing is evicted for this. */
+static void
+vm_swap_readahead (struct page *page, size_t slot) {
+	int dir;
+
+	for (dir = -1; dir <= 1; dir += 2) {
+		size_t i;
+
+		for (i = 1; i < SWAP_CLUSTER; i++) {
+			uint8_t *va = (uint8_t *) page->va + dir * (int64_t) (i * PGSIZE);
+			size_t want = dir < 0 ? slot - i : slot + i;
+			struct page *p;
+			struct frame *frame;
+
+			if ((dir < 0 && i > slot) || !is_user_vaddr (va))
+				break;
+			p = spt_find_page (page->area->spt, va);
+			if (p == NULL || p->frame != NULL
+					|| VM_TYPE (p->operations->type) != VM_ANON
+					|| p->anon.slot != want)
+				break;
+			if ((frame = frame_new ()) == NULL)
+				return;
+			if (!page_load (p, frame)) {
+				frame_free (frame, false);
+				return;
+			}
+			read_back_cnt++;
+			read_ahead_cnt++;
+		}
+	}
 }
 
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
-	struct frame *frame = vm_get_frame ();
+	struct frame *frame;
+	size_t slot = SWAP_NONE;
+	bool read_back;
 
-	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (page->frame != NULL)
+		return true;
+	if (area_is_cached (page->area, page->va))
+		return page_map_cache (page);
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+	/* A page that is no longer uninit was in memory before. */
+	read_back = VM_TYPE (page->operations->type) != VM_UNINIT;
+	if (VM_TYPE (page->operations->type) == VM_ANON)
+		slot = page->anon.slot;
 
-	return swap_in (page, frame->kva);
+	frame = vm_get_frame ();
+	if (frame == NULL)
+		return false;
+	if (!page_load (page, frame)) {
+		frame_free (frame, false);
+		return false;
+	}
+	if (read_back)
+		read_back_cnt++;
+	if (slot != SWAP_NONE)
+		vm_swap_readahead (page, slot);
+	return true;
+}
+
+/* Returns true if page VA of AREA maps a page of the page cache.  VA
+ * must lie in the part of AREA read from its file, at an offset that
+ * lines up with the cache's pages, and AREA must be a file mapping or
+ * read-only program text.  Processes that run the same program share
+ * its text that way, and writes to a running program are denied, so
+ * the text cannot change under them. */
+static bool
+area_is_cached (const struct vm_area *area, const void *va) {
+	size_t ofs = (const uint8_t *) va - (const uint8_t *) area->start;
+
+	if (area->file == NULL || (area->offset & PGMASK) != 0
+			|| ofs >= area->read_bytes)
+		return false;
+	if (VM_TYPE (area->type) == VM_FILE)
+		return true;
+
+	/* Past the end of the segment, a page of text is zeroed, but the
+	 * cached page holds what comes next in the file, unless the file
+	 * ends there. */
+	return !area->writable && (ofs + PGSIZE <= area->read_bytes
+			|| area->offset + area->read_bytes
+				>= (size_t) file_length (area->file));
+}
+
+/* Maps PAGE, which is not resident, to FRAME, a frame of the page
+ * cache, with the access its area gives.  Returns false if memory is
+ * short. */
+static bool
+page_map_frame (struct page *page, struct frame *frame) {
+	ASSERT (frame->cached);
+
+	/* It is file-backed from now on, even in an anonymous area. */
+	if (VM_TYPE (page->operations->type) == VM_UNINIT)
+		file_backed_initializer (page, page->area->type, frame->kva);
+	if (!pml4_set_page (page_pml4 (page), page->va, frame->kva,
+				page->area->writable))
+		return false;
+	frame_link (frame, page);
+	page->zero = false;
+	return true;
+}
+
+/* Maps PAGE, a page of a file mapping, to the page of the page cache
+ * that holds its part of the file, which is read in if it is not
+ * cached.  Returns false if memory is short or the file cannot be
+ * read. */
+static bool
+page_map_cache (struct page *page) {
+	struct vm_area *area = page->area;
+	off_t ofs = area->offset + ((uint8_t *) page->va - (uint8_t *) area->start);
+	struct frame *frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	frame = page_cache_get (file_get_inode (area->file), ofs);
+	return frame != NULL && page_map_frame (page, frame);
+}
+
+/* Gives PAGE, a page of the page cache, a frame, evicting another
+ * page for it if need be, and reads it in.  Returns false if no frame
+ * can be had or the read fails. */
+bool
+vm_cache_claim (struct page *page) {
+	struct frame *frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	frame = vm_get_frame ();
+	if (frame == NULL)
+		return false;
+	if (!page_load (page, frame)) {
+		frame_free (frame, false);
+		return false;
+	}
+	return true;
+}
+
+/* Gives PAGE, a page of the page cache, the user page at KVA, which
+ * holds its contents.  Returns false, leaving KVA to the caller, if
+ * memory is short. */
+bool
+vm_cache_install (struct page *page, void *kva) {
+	struct frame *frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	frame = frame_create (kva);
+	if (frame == NULL)
+		return false;
+	frame_link (frame, page);
+	frame_table_add (frame);
+	return true;
+}
+
+/* Takes PAGE, a page of the page cache, out of the cache, writing it
+ * back first if it is dirty, unless a process maps it or the kernel
+ * is using it.  PAGE is freed.  Returns true if it went. */
+bool
+vm_cache_drop (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (frame->share_cnt > 1 || frame_is_pinned (frame)
+			|| !frame_evict (frame))
+		return false;
+	frame_free (frame, false);
+	return true;
+}
+
+/* Creates a page at VA in AREA that will be initialized by INIT,
+ * given AUX, when it is first claimed.  The page is not inserted
+ * into the table yet. */
+static struct page *
+page_create (struct vm_area *area, void *va, vm_initializer *init,
+		void *aux) {
+	struct page *page = malloc (sizeof *page);
+
+	if (page == NULL)
+		return NULL;
+	uninit_new (page, va, init, area->type, aux,
+			VM_TYPE (area->type) == VM_FILE
+			? file_backed_initializer : anon_initializer);
+	page->area = area;
+	page->huge = false;
+	page->evict_stamp = 0;
+	page->zero = false;
+	page->locked = false;
+	return page;
+}
+
+/* Returns the page at VA in AREA, creating it if this is the first
+ * time it is needed.  Returns NULL if memory is short. */
+static struct page *
+area_get_page (struct vm_area *area, void *va) {
+	struct page *page = spt_find_page (area->spt, va);
+
+	if (page == NULL) {
+		page = page_create (area, va, area_init_page, NULL);
+		if (page != NULL && !spt_insert_page (area->spt, page)) {
+			vm_dealloc_page (page);
+			page = NULL;
+		}
+	}
+	return page;
+}
+
+/* Initializes PAGE, which is claimed for the first time, from its
+ * area. */
+static bool
+area_init_page (struct page *page, void *aux UNUSED) {
+	return vm_area_read_page (page, page->frame->kva);
+}
+
+/* Fills KVA with the contents PAGE starts out with: the part of its
+ * area backed by a file is read from it and the rest is zeroed. */
+bool
+vm_area_read_page (struct page *page, void *kva) {
+	struct vm_area *area = page->area;
+	size_t ofs = (uint8_t *) page->va - (uint8_t *) area->start;
+	size_t read_bytes = ofs < area->read_bytes ? area->read_bytes - ofs : 0;
+
+	if (read_bytes > PGSIZE)
+		read_bytes = PGSIZE;
+	if (read_bytes > 0
+			&& vm_file_read_at (area->file, kva, read_bytes, area->offset + ofs)
+			!= (off_t) read_bytes)
+		return false;
+	memset ((uint8_t *) kva + read_bytes, 0, PGSIZE - read_bytes);
+	return true;
+}
+
+/* Reads SIZE bytes at offset OFS of FILE into BUFFER, through the
+ * page cache, and returns the number of bytes read.  The cache takes
+ * the locks it needs. */
+off_t
+vm_file_read_at (struct file *file, void *buffer, off_t size, off_t ofs) {
+	return file_read_at (file, buffer, size, ofs);
+}
+
+/* Writes SIZE bytes from BUFFER at offset OFS of FILE straight to the
+ * disk and returns the number of bytes written, taking the file system
+ * lock unless the caller already holds it.  For writing back the
+ * pages of file mappings, which are pages of the page cache already. */
+off_t
+vm_file_write_at (struct file *file, const void *buffer, off_t size,
+		off_t ofs) {
+	return page_cache_write_direct (file_get_inode (file), buffer, size, ofs);
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	rb_init (&spt->areas, area_less, NULL);
+	radix_init (&spt->pages);
+	spt->stack = NULL;
+	spt->owner = thread_current ();
+	spt->locked_cnt = 0;
+}
+
+/* Copies PAGE, which is resident, into AREA of the current
+ * process.  PAGE is pinned meanwhile, so that finding a frame for the
+ * copy does not evict it. */
+static bool
+vm_copy_page (struct vm_area *area, struct page *page) {
+	struct page *copy = page_create (area, page->va, NULL, NULL);
+	bool success;
+
+	if (copy == NULL)
+		return false;
+	if (!spt_insert_page (area->spt, copy)) {
+		vm_dealloc_page (copy);
+		return false;
+	}
+	page->frame->pinned++;
+	success = vm_do_claim_page (copy);
+	if (success)
+		memcpy (copy->frame->kva, page->frame->kva, PGSIZE);
+	page->frame->pinned--;
+	return success;
+}
+
+/* Gives AREA of the current process a page that shares the frame of
+ * PAGE, which is resident and anonymous.  Both are mapped read-only
+ * from now on, and whichever is written first gets a copy. */
+static bool
+vm_share_page (struct vm_area *area, struct page *page) {
+	struct frame *frame = page->frame;
+	struct page *copy = page_create (area, page->va, NULL, NULL);
+
+	if (copy == NULL)
+		return false;
+	anon_initializer (copy, area->type, frame->kva);
+	if (!spt_insert_page (area->spt, copy)) {
+		vm_dealloc_page (copy);
+		return false;
+	}
+	if (!pml4_set_page (area->spt->owner->pml4, copy->va, frame->kva,
+				false)) {
+		radix_delete (&area->spt->pages, pg_no (copy->va));
+		vm_dealloc_page (copy);
+		return false;
+	}
+	frame_link (frame, copy);
+	pml4_set_writable (page_pml4 (page), page->va, false);
+	cow_share_cnt++;
+	return true;
 }
 
-/* Copy supplemental page table from src to dst */
+/* Gives AREA of the current process a page that maps the frame of
+ * PAGE, which is a page of the page cache, as PAGE does. */
+static bool
+vm_share_cache_page (struct vm_area *area, struct page *page) {
+	struct page *copy = page_create (area, page->va, NULL, NULL);
+
+	if (copy == NULL)
+		return false;
+	if (!spt_insert_page (area->spt, copy)) {
+		vm_dealloc_page (copy);
+		return false;
+	}
+	if (!page_map_frame (copy, page->frame)) {
+		radix_delete (&area->spt->pages, pg_no (copy->va));
+		vm_dealloc_page (copy);
+		return false;
+	}
+	return true;
+}
+
+/* Copy supplemental page table from src to dst.  The areas are
+ * copied, and so are the pages that the parent has resident:
+ * anonymous pages are shared copy-on-write, pages of the page cache
+ * are mapped by both, and other file-backed pages are copied.  Pages the parent never touched, and file-backed pages it
+ * had written back, are left for the child to fault in from the area,
+ * as the parent would have; anonymous pages that were evicted are
+ * brought back first. */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct rb_node *e;
+	bool success = false;
+
+	lock_acquire (&frame_lock);
+	for (e = rb_first (&src->areas); e != NULL; e = rb_next (e)) {
+		struct vm_area *area = rb_entry (e, struct vm_area, elem);
+		uint64_t key, last = pg_no (area->end) - 1;
+		struct file *file = NULL;
+		struct vm_area *copy;
+		struct page *page;
+
+		if (area->file != NULL) {
+			lock_acquire (&filesys_lock);
+			file = file_reopen (area->file);
+			lock_release (&filesys_lock);
+			if (file == NULL)
+				goto done;
+		}
+		copy = spt_add_area (dst, area->start, area->end, area->type,
+				area->writable, file, area->offset, area->read_bytes);
+		if (copy == NULL) {
+			lock_acquire (&filesys_lock);
+			file_close (file);
+			lock_release (&filesys_lock);
+			goto done;
+		}
+		copy->advice = area->advice;
+
+		for (key = pg_no (area->start);
+				(page = radix_next (&src->pages, &key, last, RADIX_ANY)) != NULL;
+				key++) {
+			if (page->frame == NULL) {
+				if (VM_TYPE (page->operations->type) != VM_ANON)
+					continue;
+				if (!vm_do_claim_page (page))
+					goto done;
+			}
+			if (page->huge && !vm_split_huge_page (page))
+				goto done;
+			if (page->frame->cached ? !vm_share_cache_page (copy, page)
+					: VM_TYPE (page->operations->type) == VM_ANON
+					? !vm_share_page (copy, page) : !vm_copy_page (copy, page))
+				goto done;
+		}
+	}
+	success = true;
+
+done:
+	lock_release (&frame_lock);
+	return success;
 }
 
-/* Free the resource hold by the supplemental page table */
+/* Free the resource hold by the supplemental page table.  Dirty
+ * file-backed pages are written back as their areas are removed.
+ * The table is left empty, ready for the next exec. */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	struct rb_node *e;
+
+	while ((e = rb_first (&spt->areas)) != NULL)
+		spt_remove_area (spt, rb_entry (e, struct vm_area, elem));
+	ASSERT (radix_size (&spt->pages) == 0);
 }
@@ -0,0 +1,246 @@
+/* zswap.c: Compressed cache in front of the swap disk.
+
+   An anonymous page that is evicted is compressed and kept in kernel
+   memory instead of being written to swap, so that if it is faulted
+   back in soon it costs a decompression instead of a disk read, and
+   if it is freed first it never reaches the disk at all.
+
+   The cache is a "zbud" arena: each arena page holds at most two
+   compressed pages, one packed against its start and one against its
+   end.  This wastes some space but makes the arena simple, with no
+   fragmentation to manage.  A page that does not compress to half a
+   page or less would not share an arena page, so it bypasses the
+   cache and goes straight to disk.
+
+   Arena pages are taken from the kernel pool as needed, up to
+   zswap_max_pages.  When the arena is full, the arena page filled
+   longest ago has its pages written back to swap and is reused. */
+
+#include "vm/zswap.h"
+#include "vm/vm.h"
+#include <list.h>
+#include <lz.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Largest compressed page the cache takes. */
+#define ZSWAP_MAX_LEN (PGSIZE / 2)
+
+/* An arena page. */
+struct zbud {
+	struct list_elem elem;      /* In zbud_lru. */
+	uint8_t *kva;               /* The arena page. */
+	struct page *pages[2];      /* Pages at the start and at the end. */
+	size_t lens[2];             /* Their compressed lengths. */
+};
+
+size_t zswap_max_pages;
+
+static struct list zbud_lru;    /* Arena pages, least recently filled first. */
+static size_t zbud_cnt;         /* Arena pages in use. */
+static struct lock zswap_lock;  /* Protects all of the above. */
+
+/* Scratch space, also under zswap_lock. */
+static void *lz_work;           /* For lz_compress(), LZ_WORK_SIZE bytes. */
+static uint8_t *zbuf;           /* A page compressed. */
+static uint8_t *wbuf;           /* A page decompressed for writeback. */
+
+/* Statistics. */
+static long long store_cnt;     /* Pages stored. */
+static long long bypass_cnt;    /* Pages that did not compress well. */
+static long long hit_cnt;       /* Pages loaded. */
+static long long writeback_cnt; /* Pages written back to swap. */
+static long long bytes_in;      /* Bytes stored, before compression... */
+static long long bytes_out;     /* ...and after. */
+
+/* Sets up the cache, if it is turned on. */
+void
+zswap_init (void) {
+	list_init (&zbud_lru);
+	lock_init (&zswap_lock);
+	if (zswap_max_pages == 0)
+		return;
+
+	lz_work = palloc_get_multiple (PAL_ASSERT,
+			DIV_ROUND_UP (LZ_WORK_SIZE, PGSIZE));
+	zbuf = palloc_get_page (PAL_ASSERT);
+	wbuf = palloc_get_page (PAL_ASSERT);
+}
+
+/* Returns the compressed data of buddy I of ZBUD. */
+static uint8_t *
+zbud_data (struct zbud *zbud, int i) {
+	return i == 0 ? zbud->kva : zbud->kva + PGSIZE - zbud->lens[i];
+}
+
+/* Returns which buddy of its arena page PAGE is. */
+static int
+zbud_index (struct page *page) {
+	struct zbud *zbud = page->anon.zbud;
+
+	ASSERT (zbud->pages[0] == page || zbud->pages[1] == page);
+	return zbud->pages[0] == page ? 0 : 1;
+}
+
+/* Takes buddy I out of ZBUD, freeing ZBUD if that leaves it empty. */
+static void
+zbud_remove (struct zbud *zbud, int i) {
+	zbud->pages[i]->anon.zbud = NULL;
+	zbud->pages[i] = NULL;
+	zbud->lens[i] = 0;
+	if (zbud->pages[!i] == NULL) {
+		list_remove (&zbud->elem);
+		palloc_free_page (zbud->kva);
+		free (zbud);
+		zbud_cnt--;
+	}
+}
+
+/* Writes the pages in ZBUD back to swap, leaving it empty but not
+ * freed.  Returns false if swap is full, with any pages it could not
+ * write still in ZBUD. */
+static bool
+zbud_writeback (struct zbud *zbud) {
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		struct page *page = zbud->pages[i];
+
+		if (page == NULL)
+			continue;
+		if (!lz_decompress (zbud_data (zbud, i), zbud->lens[i], wbuf, PGSIZE))
+			PANIC ("zswap: corrupt page");
+		if (!anon_swap_write (page, wbuf))
+			return false;
+		page->anon.zbud = NULL;
+		zbud->pages[i] = NULL;
+		zbud->lens[i] = 0;
+		writeback_cnt++;
+	}
+	return true;
+}
+
+/* Returns an arena page with room for LEN more bytes and a free
+ * buddy, or NULL if there is none and none can be had. */
+static struct zbud *
+zbud_find (size_t len) {
+	struct list_elem *e;
+	struct zbud *zbud;
+
+	for (e = list_begin (&zbud_lru); e != list_end (&zbud_lru);
+			e = list_next (e)) {
+		zbud = list_entry (e, struct zbud, elem);
+		if ((zbud->pages[0] == NULL || zbud->pages[1] == NULL)
+				&& zbud->lens[0] + zbud->lens[1] + len <= PGSIZE)
+			return zbud;
+	}
+
+	if (zbud_cnt < zswap_max_pages) {
+		zbud = calloc (1, sizeof *zbud);
+		if (zbud == NULL)
+			return NULL;
+		zbud->kva = palloc_get_page (0);
+		if (zbud->kva == NULL) {
+			free (zbud);
+			return NULL;
+		}
+		list_push_back (&zbud_lru, &zbud->elem);
+		zbud_cnt++;
+		return zbud;
+	}
+
+	if (list_empty (&zbud_lru))
+		return NULL;
+	zbud = list_entry (list_front (&zbud_lru), struct zbud, elem);
+	return zbud_writeback (zbud) ? zbud : NULL;
+}
+
+/* Compresses PAGE, which must be resident, into the cache.  Returns
+ * false if the cache is off, PAGE does not compress well, or there is
+ * no room, in which case PAGE should go to swap. */
+bool
+zswap_store (struct page *page) {
+	struct zbud *zbud;
+	size_t len;
+	int i;
+
+	ASSERT (page->anon.zbud == NULL);
+
+	if (zswap_max_pages == 0)
+		return false;
+
+	lock_acquire (&zswap_lock);
+	len = lz_compress (page->frame->kva, PGSIZE, zbuf, ZSWAP_MAX_LEN, lz_work);
+	if (len == 0) {
+		bypass_cnt++;
+		lock_release (&zswap_lock);
+		return false;
+	}
+	zbud = zbud_find (len);
+	if (zbud == NULL) {
+		lock_release (&zswap_lock);
+		return false;
+	}
+
+	i = zbud->pages[0] == NULL ? 0 : 1;
+	zbud->pages[i] = page;
+	zbud->lens[i] = len;
+	memcpy (zbud_data (zbud, i), zbuf, len);
+	list_remove (&zbud->elem);
+	list_push_back (&zbud_lru, &zbud->elem);
+	page->anon.zbud = zbud;
+
+	store_cnt++;
+	bytes_in += PGSIZE;
+	bytes_out += len;
+	lock_release (&zswap_lock);
+	return true;
+}
+
+/* Decompresses PAGE, which must be in the cache, into KVA and takes
+ * it out of the cache.  Returns false if its data is corrupt. */
+bool
+zswap_load (struct page *page, void *kva) {
+	struct zbud *zbud = page->anon.zbud;
+	bool ok;
+	int i;
+
+	lock_acquire (&zswap_lock);
+	i = zbud_index (page);
+	ok = lz_decompress (zbud_data (zbud, i), zbud->lens[i], kva, PGSIZE);
+	zbud_remove (zbud, i);
+	hit_cnt++;
+	lock_release (&zswap_lock);
+	return ok;
+}
+
+/* Takes PAGE out of the cache, if it is there, without loading it. */
+void
+zswap_invalidate (struct page *page) {
+	struct zbud *zbud = page->anon.zbud;
+
+	if (zbud == NULL)
+		return;
+	lock_acquire (&zswap_lock);
+	zbud_remove (zbud, zbud_index (page));
+	lock_release (&zswap_lock);
+}
+
+/* Prints compressed cache statistics. */
+void
+zswap_print_stats (void) {
+	if (zswap_max_pages == 0)
+		return;
+	printf ("Zswap: %zu of %zu pages in use, %lld pages stored, "
+			"%lld bypassed, %lld hits, %lld written back\n",
+			zbud_cnt, zswap_max_pages, store_cnt, bypass_cnt, hit_cnt,
+			writeback_cnt);
+	printf ("Zswap: pages compressed to %lld%%, %lld swap writes saved\n",
+			bytes_in > 0 ? bytes_out * 100 / bytes_in : 0,
+			store_cnt - writeback_cnt);
+}